@@ -0,0 +1,94 @@
+#include "frontend/Resampler.hpp"
+
+#include <chrono>
+#include <random>
+#include <fmt/format.h>
+
+
+//Checks the resampler's SIMD interpolation against the scalar one, then times both. Build with -DSB_BENCHMARKS=ON.
+
+#if defined(SB_SSE2)
+    #define SIMD_NAME "SSE2"
+#else
+    #define SIMD_NAME "scalar"
+#endif
+
+constexpr usize BUFFER_FRAMES = 1024;
+constexpr usize ITERATIONS = 1 << 12;
+
+//Every position against histories of random samples, with the loudest ones mixed in so the clamping gets checked too
+bool check_interpolate(std::mt19937 &random) {
+    const s16 extremes[4] = {-32768, 32767, 0, -1};
+
+    for(u32 t = 0; t < Resampler::ONE; t++) {
+        Resampler::History history;
+
+        for(u32 i = 0; i < 8; i++) {
+            history[i / 4][i % 4] = random() & 8 ? extremes[random() & 3] : (s16)random();
+        }
+
+        s16 simd[2], scalar[2];
+        Resampler::interpolate(history, t, simd);
+        Resampler::interpolate_scalar(history, t, scalar);
+
+        if(simd[0] != scalar[0] || simd[1] != scalar[1]) {
+            fmt::print("interpolate differs at t = {}\n", t);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    std::mt19937 random(1);
+
+    if(!check_interpolate(random)) {
+        return 1;
+    }
+
+    fmt::print("interpolate matches the scalar version, timing {} against scalar\n", SIMD_NAME);
+
+    s16 in[BUFFER_FRAMES * 2];
+    s16 out[BUFFER_FRAMES * 2];
+
+    for(s16 &sample : in) sample = random();
+
+    //The whole resampler, squeezing a buffer and a bit into one the way fast forward does
+    Resampler resampler;
+    auto start = std::chrono::steady_clock::now();
+
+    for(usize i = 0; i < ITERATIONS; i++) {
+        resampler.process(in, BUFFER_FRAMES, out, BUFFER_FRAMES * 7 / 8);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    fmt::print("process           {} {:6.2f} ns/frame ({})\n", SIMD_NAME, elapsed.count() / (ITERATIONS * BUFFER_FRAMES * 7 / 8), out[0]);
+
+    //And just the interpolation on its own
+    Resampler::History history = {{in[0], in[2], in[4], in[6]}, {in[1], in[3], in[5], in[7]}};
+    s32 sink = 0;
+
+    for(u32 pass = 0; pass < 2; pass++) {
+        start = std::chrono::steady_clock::now();
+
+        for(usize i = 0; i < ITERATIONS * BUFFER_FRAMES; i++) {
+            s16 frame[2];
+
+            if(pass == 0) {
+                Resampler::interpolate_scalar(history, i & (Resampler::ONE - 1), frame);
+            } else {
+                Resampler::interpolate(history, i & (Resampler::ONE - 1), frame);
+            }
+
+            sink += frame[0] + frame[1];
+        }
+
+        elapsed = std::chrono::steady_clock::now() - start;
+        fmt::print("interpolate       {:6} {:6.2f} ns/frame\n", pass == 0 ? "scalar" : SIMD_NAME, elapsed.count() / (ITERATIONS * BUFFER_FRAMES));
+    }
+
+    fmt::print("({})\n", sink);
+
+    return 0;
+}
\ No newline at end of file
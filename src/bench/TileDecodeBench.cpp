@@ -0,0 +1,103 @@
+#include "emulator/core/ppu/TileDecode.hpp"
+#include "emulator/device/VideoDevice.hpp"
+#include "common/Defines.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <fmt/format.h>
+
+
+//Checks the SIMD kernels against the scalar ones, then times both. Build with -DSB_BENCHMARKS=ON, and with -mavx2 added
+//to the compiler flags to get the AVX2 path.
+
+#if defined(SB_AVX2)
+    #define SIMD_NAME "AVX2"
+#elif defined(SB_SSE2)
+    #define SIMD_NAME "SSE2"
+#else
+    #define SIMD_NAME "scalar"
+#endif
+
+constexpr usize LINE_WIDTH = 160;
+constexpr usize DECODE_ITERATIONS = 1 << 24;
+constexpr usize LINE_ITERATIONS = 1 << 20;
+
+//Runs the function and returns how many nanoseconds each call took on average
+template<typename Function>
+double time_ns(usize iterations, Function function) {
+    auto start = std::chrono::steady_clock::now();
+
+    for(usize i = 0; i < iterations; i++) {
+        function(i);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+//Every pair of bit planes has to decode the same
+bool check_decode() {
+    for(u32 planes = 0; planes < 0x10000; planes++) {
+        u8 simd[8], scalar[8];
+        sb::decode_2bpp(planes & 0xFF, planes >> 8, simd);
+        sb::decode_2bpp_scalar(planes & 0xFF, planes >> 8, scalar);
+
+        if(memcmp(simd, scalar, 8) != 0) {
+            fmt::print("decode_2bpp differs for low = 0x{:02X}, high = 0x{:02X}\n", planes & 0xFF, planes >> 8);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//Every length up to a whole line, so the leftovers the vector loops hand to the scalar one get checked too. Shades are
+//random bytes since only the bottom 2 bits are supposed to be used.
+bool check_rgba(std::mt19937 &random) {
+    u8 shades[LINE_WIDTH];
+    u32 simd[LINE_WIDTH], scalar[LINE_WIDTH];
+
+    for(usize count = 0; count <= LINE_WIDTH; count++) {
+        for(u8 &shade : shades) shade = random();
+
+        sb::shades_to_rgba(shades, sb::DMG_SHADES, simd, count);
+        sb::shades_to_rgba_scalar(shades, sb::DMG_SHADES, scalar, count);
+
+        if(memcmp(simd, scalar, count * sizeof(u32)) != 0) {
+            fmt::print("shades_to_rgba differs for {} pixels\n", count);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    std::mt19937 random(1);
+
+    if(!check_decode() || !check_rgba(random)) {
+        return 1;
+    }
+
+    fmt::print("Both kernels match the scalar versions, timing {} against scalar\n", SIMD_NAME);
+
+    //Results get added up so none of the calls can be optimized away
+    u32 sink = 0;
+    u8 row[8];
+    u8 shades[LINE_WIDTH];
+    u32 line[LINE_WIDTH];
+
+    for(u8 &shade : shades) shade = random() & 3;
+
+    double decode_scalar = time_ns(DECODE_ITERATIONS, [&](usize i) { sb::decode_2bpp_scalar(i, i >> 8, row); sink += row[i & 7]; });
+    double decode_simd = time_ns(DECODE_ITERATIONS, [&](usize i) { sb::decode_2bpp(i, i >> 8, row); sink += row[i & 7]; });
+    double rgba_scalar = time_ns(LINE_ITERATIONS, [&](usize i) { sb::shades_to_rgba_scalar(shades, sb::DMG_SHADES, line, LINE_WIDTH); sink += line[i % LINE_WIDTH]; });
+    double rgba_simd = time_ns(LINE_ITERATIONS, [&](usize i) { sb::shades_to_rgba(shades, sb::DMG_SHADES, line, LINE_WIDTH); sink += line[i % LINE_WIDTH]; });
+
+    fmt::print("decode_2bpp       scalar {:6.1f} ns/row     {} {:6.1f} ns/row\n", decode_scalar, SIMD_NAME, decode_simd);
+    fmt::print("shades_to_rgba    scalar {:6.1f} ns/line    {} {:6.1f} ns/line\n", rgba_scalar, SIMD_NAME, rgba_simd);
+    fmt::print("({})\n", sink);
+
+    return 0;
+}
\ No newline at end of file
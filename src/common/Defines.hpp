@@ -23,5 +23,24 @@
     #error "Unable to detect endianness"
 #endif
 
+//Architecture, only x86-64 has a recompiler
+#if defined(__x86_64__) || defined(_M_X64)
+    #define SB_ARCH_X64
+#endif
+
+//SIMD, every x86-64 CPU has SSE2 but AVX2 has to be turned on when compiling
+#if defined(SB_ARCH_X64) || defined(__SSE2__)
+    #define SB_SSE2
+#endif
+
+#if defined(__AVX2__)
+    #define SB_AVX2
+#endif
+
+//Threaded dispatch for the interpreter gets turned on from CMake, it needs the labels as values extension from GCC and Clang
+#if defined(SB_THREADED_DISPATCH) && !defined(__GNUC__)
+    #undef SB_THREADED_DISPATCH
+#endif
+
 
 #endif //DEFINES_HPP
\ No newline at end of file
@@ -3,12 +3,13 @@
 
 #include "Types.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <string_view>
-#include <stdexcept>
-#include <mutex>
 
 
 constexpr u16 KiB = 1024;
+constexpr usize CACHE_LINE_SIZE = 64;
 
 inline constexpr std::string_view base_name(const std::string_view &path, const std::string_view &delims = "/\\") {
 	return path.substr(path.find_last_of(delims) + 1);
@@ -22,51 +23,75 @@ inline constexpr u16 to_u16(u8 high, u8 low) {
 	return (high << 8) | low;
 }
 
+inline constexpr u8 reverse_bits(u8 value) {
+	value = ((value & 0xF0) >> 4) | ((value & 0x0F) << 4);
+	value = ((value & 0xCC) >> 2) | ((value & 0x33) << 2);
+	return ((value & 0xAA) >> 1) | ((value & 0x55) << 1);
+}
+
 template<typename T>
 inline constexpr bool in_range(T value, T min, T max) {
 	return value >= min  && value <= max;
 }
 
+//Wait-free ring buffer for exactly one thread pushing and one thread popping. The indices only ever go up and are
+//wrapped when used, so the whole capacity can be filled, and each of them gets its own cache line so the two threads
+//don't keep stealing it from each other.
 template<class T, usize _capacity>
 class RingBuffer {
 private:
 
-	T m_buffer[_capacity];
-	usize m_head, m_tail;
-	usize m_size;
-	std::mutex m_lock;
+	static_assert((_capacity & (_capacity - 1)) == 0, "RingBuffer capacity must be a power of 2!");
+
+	alignas(CACHE_LINE_SIZE) std::atomic<usize> m_head; //Only written by the producer
+	alignas(CACHE_LINE_SIZE) std::atomic<usize> m_tail; //Only written by the consumer
+	alignas(CACHE_LINE_SIZE) T m_buffer[_capacity];
 
 public:
 
 	RingBuffer() : m_head(0), m_tail(0) { }
 
-	void push_back(T value) {
-		m_lock.lock();
-		m_buffer[m_head] = value;
-		m_head = (m_head + 1) % _capacity;
-		m_lock.unlock();
+	//Pushes as many values as there's room for, and returns how many that was
+	usize push_n(const T *values, usize count) {
+		usize head = m_head.load(std::memory_order_relaxed);
+		usize tail = m_tail.load(std::memory_order_acquire);
+		count = std::min(count, _capacity - (head - tail));
+
+		usize start = head & (_capacity - 1);
+		usize first = std::min(count, _capacity - start);
+		std::copy_n(values, first, m_buffer + start);
+		std::copy_n(values + first, count - first, m_buffer);
+
+		m_head.store(head + count, std::memory_order_release);
+		return count;
 	}
 
-	T pop_front() {
-		//Check if it's empty
-		if(m_head == m_tail) {
-			throw new std::out_of_range("Trying to pop front of an empty RingBuffer!");
-		}
+	//Pops up to count values, and returns how many there were
+	usize pop_n(T *values, usize count) {
+		usize tail = m_tail.load(std::memory_order_relaxed);
+		usize head = m_head.load(std::memory_order_acquire);
+		count = std::min(count, head - tail);
 
-		m_lock.lock();
-		T &elem = m_buffer[m_tail];
-		m_tail = (m_tail + 1) % _capacity;
-		m_lock.unlock();
+		usize start = tail & (_capacity - 1);
+		usize first = std::min(count, _capacity - start);
+		std::copy_n(m_buffer + start, first, values);
+		std::copy_n(m_buffer, count - first, values + first);
+
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	bool push_back(T value) {
+		return push_n(&value, 1) == 1;
+	}
 
-		return elem;
+	bool pop_front(T &value) {
+		return pop_n(&value, 1) == 1;
 	}
 
+	//Throws away everything in it, only the consumer can do this
 	void clear() {
-		m_lock.lock();
-		m_head = 0;
-		m_tail = 0;
-		m_buffer[0] = 0;
-		m_lock.unlock();
+		m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
 	}
 
 	usize capacity() {
@@ -74,7 +99,8 @@ public:
 	}
 
 	usize size() {
-		return m_head >= m_tail ? m_head - m_tail : (_capacity - m_tail) + m_head;
+		usize tail = m_tail.load(std::memory_order_acquire);
+		return m_head.load(std::memory_order_acquire) - tail;
 	}
 };
 
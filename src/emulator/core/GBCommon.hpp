@@ -23,6 +23,9 @@ struct GameboySettings {
     bool force_model = false;
     bool save_load_ram = true;
     bool stub_ly = false;
+    bool jit = false;
+    bool jit_lockstep = false;
+    bool scanline_renderer = false;
 };
 
 } //namespace sb
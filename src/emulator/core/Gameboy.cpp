@@ -7,26 +7,26 @@
 namespace sb {
 
 Gameboy::Gameboy(const std::string &rom_path, const std::string &boot_path, GameboySettings settings)
-: m_memory(m_cpu, m_ppu, m_apu, m_timer, settings.input_device), m_cpu(m_memory, m_scheduler.cpu_clock, m_model, boot_path.empty()), 
-m_ppu(m_cpu, m_memory, m_scheduler.ppu_clock, settings.video_device, settings.stub_ly), m_apu(m_timer, settings.audio_device), m_timer(m_cpu),
+: m_memory(m_cpu, m_ppu, m_apu, m_timer, m_scheduler, settings.input_device), m_cpu(m_memory, m_scheduler.clock, m_model, boot_path.empty()), 
+m_ppu(m_cpu, m_memory, m_scheduler, settings.video_device, settings.stub_ly, settings.scanline_renderer), m_apu(m_timer, m_scheduler, settings.audio_device), m_timer(m_cpu, m_scheduler),
 m_save_load_ram(settings.save_load_ram), m_model(settings.model), m_force_model(settings.force_model) {
     m_scheduler.set_cpu_step([&]() {
-        if(!m_cpu.halted() && !m_cpu.stopped()) {
-            m_cpu.step();
-        } else {
-            //Execute a nop while halted
-            m_cpu.nop();
-        }
-        m_cpu.service_interrupts();
+        m_cpu.run(m_scheduler); //As many instructions as it can before anything else is due
     });
-    m_scheduler.set_ppu_step([&]() { 
-        if(!m_cpu.stopped()) {
-            m_ppu.step(); m_apu.step(); m_timer.step();
-        } else {
-            m_ppu.cycle_empty(); //Keep the clock ticking
+    m_scheduler.set_tick([&](u64 cycles) {
+        //Nothing is ticked here anymore, everything catches itself up whenever it's accessed or has an event
+        if(m_cpu.stopped()) {
+            m_scheduler.delay_events(cycles); //Keep the clock ticking, but nothing else
+            m_ppu.delay(cycles);
+            m_timer.delay(cycles);
+            m_apu.delay(cycles);
         }
     });
 
+    if(settings.jit) {
+        m_cpu.enable_jit(settings.jit_lockstep);
+    }
+
     load_rom(rom_path, m_save_load_ram);
     if(!boot_path.empty()) load_boot(boot_path);
 
@@ -129,6 +129,12 @@ void Gameboy::save_ram() {
 
 void Gameboy::run_for(usize cycles) {
     m_scheduler.run_for(cycles);
+    m_apu.flush(); //So the audio device has every sample up to now
+}
+
+//Draws one frame, then only keeps the timing for the next few, FRAME_SKIP_ALL never draws
+void Gameboy::set_frame_skip(u32 frames) {
+    m_ppu.set_frame_skip(frames);
 }
 
 std::string Gameboy::get_title() {
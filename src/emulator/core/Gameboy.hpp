@@ -19,12 +19,12 @@ namespace sb {
 class Gameboy {
 private:
 
+    Scheduler m_scheduler; //Constructed first since everything else schedules on it
+    Memory m_memory;       //Then memory, the CPU's reset already writes to it
     CPU m_cpu;
     PPU m_ppu;
     APU m_apu;
-    Memory m_memory;
     Timer m_timer;
-    Scheduler m_scheduler;
 
     GB_MODEL m_model;
     bool m_force_model;
@@ -44,7 +44,10 @@ public:
     void save_ram();
 
     void run_for(usize cycles);
+    void set_frame_skip(u32 frames);
     std::string get_title();
+
+    friend class FlagFuzzer;
 };
 
 } //namespace sb
@@ -4,12 +4,14 @@
 
 namespace sb {
 
-Mapper::Mapper() { }
+Mapper::Mapper() : m_mbc(nullptr) { }
 
-Mapper::~Mapper() {
-    if(m_mbc != nullptr) {
-        delete m_mbc;
-    }
+template<typename T>
+void Mapper::setup(T &mbc, u8 rom_banks, u8 ram_banks, u8 *rom_data) {
+    mbc.init(rom_banks, ram_banks);
+    mbc.load_rom(rom_data);
+    mbc.update_banks();
+    m_mbc = &mbc;
 }
 
 void Mapper::create(u8 code, u8 rom_banks, u8 ram_banks, u8 *rom_data) {
@@ -17,30 +19,33 @@ void Mapper::create(u8 code, u8 rom_banks, u8 ram_banks, u8 *rom_data) {
     MBCInfo info = info_from_code(code);
 
     switch(info.type) {
-        case NO_MBC : m_mbc = new NoMBC(info.has_ram, info.has_battery); LOG_INFO("[MAP] : No MBC");
+        case NO_MBC : LOG_INFO("[MAP] : No MBC"); setup(m_mbcs.emplace<NoMBC>(info.has_ram, info.has_battery), rom_banks, ram_banks, rom_data);
         break;
-        case MBC_1 : m_mbc = new MBC1(info.has_ram, info.has_battery); LOG_INFO("[MAP] : MBC1");
+        case MBC_1 : LOG_INFO("[MAP] : MBC1"); setup(m_mbcs.emplace<MBC1>(info.has_ram, info.has_battery), rom_banks, ram_banks, rom_data);
         break;
-        case MBC_3 : m_mbc = new MBC3(info.has_ram, info.has_battery, info.has_timer); LOG_INFO("[MAP] : MBC3");
+        case MBC_3 : LOG_INFO("[MAP] : MBC3"); setup(m_mbcs.emplace<MBC3>(info.has_ram, info.has_battery, info.has_timer), rom_banks, ram_banks, rom_data);
         break;
-        case MBC_5 : m_mbc = new MBC5(info.has_ram, info.has_battery); LOG_INFO("[MAP] : MBC5");
+        case MBC_5 : LOG_INFO("[MAP] : MBC5"); setup(m_mbcs.emplace<MBC5>(info.has_ram, info.has_battery), rom_banks, ram_banks, rom_data);
         break;
     }
-
-    m_mbc->init(rom_banks, ram_banks);
-    m_mbc->load_rom(rom_data);
 }
 
 bool Mapper::in_address_space(u16 address) {
     return m_mbc->in_address_space(address);
 }
 
+//Only register writes need to know which MBC this is
 void Mapper::write(u16 address, u8 value) {
-    m_mbc->write(address, value);
-}
-
-u8 Mapper::read(u16 address) {
-    return m_mbc->read(address);
+    if(address <= 0x7FFF) {
+        std::visit([address, value](auto &mbc) {
+            if constexpr(!std::is_same_v<std::decay_t<decltype(mbc)>, std::monostate>) {
+                mbc.write_register(address, value);
+                mbc.update_banks();
+            }
+        }, m_mbcs);
+    } else {
+        m_mbc->write_ram(address, value);
+    }
 }
 
 
@@ -51,6 +56,24 @@ bool MBC::in_address_space(u16 address) {
     return in_range<u16>(address, 0x0000, 0x7FFF) || in_range<u16>(address, 0xA000, 0xBFFF);
 }
 
+//Bank numbers wrap around the actual size of the ROM or RAM, like the unused upper bits not being connected
+void MBC::map_rom(u16 bank0, u16 bank1) {
+    u16 mask = (m_rom.size() / (16 * KiB)) - 1;
+
+    m_rom_bank[0] = bank0 & mask;
+    m_rom_bank[1] = bank1 & mask;
+    m_rom_base[0] = &m_rom[m_rom_bank[0] * 16 * KiB];
+    m_rom_base[1] = &m_rom[m_rom_bank[1] * 16 * KiB];
+}
+
+void MBC::map_ram(bool enabled, u8 bank) {
+    m_ram_base = enabled && m_ram_banks != 0 ? &m_ram[(bank & (m_ram_banks - 1)) * 8 * KiB] : nullptr;
+}
+
+void MBC::load_rom(u8 *rom_data) {
+    memcpy(m_rom.data(), rom_data, m_rom.size());
+}
+
 //For loading RAM from a file
 void MBC::load_ram(u8 *ram_data) {
     memcpy(m_ram.data(), ram_data, m_ram_banks * 8 * KiB);
@@ -71,31 +94,9 @@ void NoMBC::init(u8 rom_banks, u8 ram_banks) {
     }
 }
 
-//Load 2 banks of ROM
-void NoMBC::load_rom(u8 *rom_data) {
-    memcpy(m_rom.data(), rom_data, 32 * KiB);
-}
-
-void NoMBC::write(u16 address, u8 value) {
-    if(in_range<u16>(address, 0x0000, 0x7FFF)) {
-        //ROM - Can't write to ROM on this one
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF)) {
-        //RAM
-        m_ram[address - 0xA000] = value;
-    }
-}
-
-u8 NoMBC::read(u16 address) {
-    if(in_range<u16>(address, 0x0000, 0x7FFF)) {
-        //ROM
-        return m_rom[address];
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF)) {
-        //RAM
-        return m_ram[address - 0xA000];
-    }
-
-    //This should never happen
-    return 0;
+void NoMBC::update_banks() {
+    map_rom(0, 1);
+    map_ram(true, 0);
 }
 
 
@@ -115,11 +116,7 @@ void MBC1::init(u8 rom_banks, u8 ram_banks) {
     m_ram.resize(m_ram_banks * 8 * KiB);
 }
 
-void MBC1::load_rom(u8 *rom_data) {
-    memcpy(m_rom.data(), rom_data, m_rom_banks * 16 * KiB);
-}
-
-void MBC1::write(u16 address, u8 value) {
+void MBC1::write_register(u16 address, u8 value) {
     if(in_range<u16>(address, 0x0000, 0x1FFF)) {
         //RAM Enable
         m_ram_enable = (value & 0xf) == 0xa;
@@ -134,40 +131,12 @@ void MBC1::write(u16 address, u8 value) {
     } else if(in_range<u16>(address, 0x6000, 0x7FFF)) {
         //ROM/RAM Mode Select
         m_mode = value & 1;
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0) {
-        //RAM bank whatever
-        u8 ram_bank = m_mode ? m_selected_bank2 : 0;
-        if(m_ram_enable) m_ram[(address - 0xA000) + ram_bank * 8 * KiB] = value;
     }
 }
 
-u8 MBC1::read(u16 address) {
-    if(in_range<u16>(address, 0x0000, 0x3FFF)) {
-        //ROM bank 0
-        u8 rom_bank = m_mode ? m_selected_bank2 << 5 : 0;
-
-        u32 new_address = (address & 0x3FFF) | (rom_bank * 16 * KiB);
-
-        //return m_rom[address + rom_bank * 16 * kilobyte];
-        return m_rom[new_address & (m_rom.size() - 1)];
-    } else if(in_range<u16>(address, 0x4000, 0x7FFF)) {
-        //ROM bank whatever
-        //u8 rom_bank = m_mode ? m_selected_bank : m_selected_bank | (m_selected_bank2 << 5);
-        u8 rom_bank = m_selected_bank | (m_selected_bank2 << 5);
-
-        u32 new_address = (address & 0x3FFF) | (rom_bank * 16 * KiB);
-
-        //return m_rom[(address - 0x4000) + rom_bank * 16 * kilobyte];
-        return m_rom[new_address & (m_rom.size() - 1)];
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0) {
-        //RAM bank whatever
-        u8 ram_bank = m_mode ? m_selected_bank2 : 0;
-        u32 new_address = (address & 0x1FFF) | (ram_bank * 8 * KiB);
-        //if(m_ram_enable) return m_ram[(address - 0xA000) + ram_bank * 8 * kilobyte];
-        if(m_ram_enable) return m_ram[new_address & (m_ram.size() - 1)];
-    }
-
-    return 0xff;
+void MBC1::update_banks() {
+    map_rom(m_mode ? m_selected_bank2 << 5 : 0, m_selected_bank | (m_selected_bank2 << 5));
+    map_ram(m_ram_enable, m_mode ? m_selected_bank2 : 0);
 }
 
 
@@ -187,11 +156,7 @@ void MBC3::init(u8 rom_banks, u8 ram_banks) {
     m_ram.resize(m_ram_banks * 8 * KiB);
 }
 
-void MBC3::load_rom(u8 *rom_data) {
-    memcpy(m_rom.data(), rom_data, m_rom_banks * 16 * KiB);
-}
-
-void MBC3::write(u16 address, u8 value) {
+void MBC3::write_register(u16 address, u8 value) {
     if(in_range<u16>(address, 0x0000, 0x1FFF)) {
         //RAM Enable
         m_ram_enable = (value & 0xf) == 0xa;
@@ -205,27 +170,13 @@ void MBC3::write(u16 address, u8 value) {
         m_selected_ram = value; //RAM banks is 00-07, RTC is 08-0C
     } else if(in_range<u16>(address, 0x6000, 0x7FFF)) {
         //Latch clock data
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0 && m_selected_ram < 8) {
-        //RAM bank whatever
-        if(m_ram_enable) m_ram[(address - 0xA000) + m_selected_ram * 8 * KiB] = value;
     }
 }
 
-u8 MBC3::read(u16 address) {
-    if(in_range<u16>(address, 0x0000, 0x3FFF)) {
-        //ROM bank 0
-        return m_rom[address];
-    } else if(in_range<u16>(address, 0x4000, 0x7FFF)) {
-        //ROM bank whatever
-        return m_rom[(address - 0x4000) + m_selected_rom * 16 * KiB];
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0 && m_selected_ram < 8) {
-        //RAM bank whatever
-        if(m_ram_enable) return m_ram[(address - 0xA000) + m_selected_ram * 8 * KiB];
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF)){
-        //LOG_INFO("Attempting to read from RTC");
-    }
-
-    return 0xff;
+//RAM banks are 00-07, reading the RTC registers isn't supported yet
+void MBC3::update_banks() {
+    map_rom(0, m_selected_rom);
+    map_ram(m_ram_enable && m_selected_ram < 8, m_selected_ram);
 }
 
 
@@ -245,11 +196,7 @@ void MBC5::init(u8 rom_banks, u8 ram_banks) {
     m_ram.resize(m_ram_banks * 8 * KiB);
 }
 
-void MBC5::load_rom(u8 *rom_data) {
-    memcpy(m_rom.data(), rom_data, m_rom_banks * 16 * KiB);
-}
-
-void MBC5::write(u16 address, u8 value) {
+void MBC5::write_register(u16 address, u8 value) {
     if(in_range<u16>(address, 0x0000, 0x1FFF)) {
         //RAM Enable
         m_ram_enable = (value & 0xf) == 0xa;
@@ -265,25 +212,12 @@ void MBC5::write(u16 address, u8 value) {
         //RAM Bank Number, 0x00 - 0x0F
         //Also on cartridges with rumble, bit 3 controls the rumble motor.
         m_selected_ram = value & 0xf;
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0 && m_ram_enable) {
-        //RAM bank whatever
-        m_ram[(address - 0xA000) + m_selected_ram * 8 * KiB] = value;
     }
 }
 
-u8 MBC5::read(u16 address) {
-    if(in_range<u16>(address, 0x0000, 0x3FFF)) {
-        //ROM bank 0
-        return m_rom[address];
-    } else if(in_range<u16>(address, 0x4000, 0x7FFF)) {
-        //ROM bank whatever
-        return m_rom[(address - 0x4000) + m_selected_rom * 16 * KiB];
-    } else if(in_range<u16>(address, 0xA000, 0xBFFF) && m_ram_banks != 0 && m_ram_enable) {
-        //RAM bank whatever
-        return m_ram[(address - 0xA000) + m_selected_ram * 8 * KiB];
-    }
-
-    return 0xff;
+void MBC5::update_banks() {
+    map_rom(0, m_selected_rom);
+    map_ram(m_ram_enable, m_selected_ram);
 }
 
 } //namespace sb
\ No newline at end of file
@@ -4,8 +4,8 @@
 #include "common/Types.hpp"
 #include "common/Log.hpp"
 
+#include <variant>
 #include <vector>
-#include <unordered_map>
 
 
 namespace sb {
@@ -43,31 +43,43 @@ constexpr MBCInfo info_from_code(u8 code) {
 }
 
 //MBC (Memory Bank Controller), intercepts writes to certain ROM or RAM addresses on the cartridge and switches ROM or RAM banks
-//allowing for much more memory than a plain Gameboy cartridge can hold.
+//allowing for much more memory than a plain Gameboy cartridge can hold. The banks that are currently mapped in are kept as
+//pointers, so only register writes depend on the type of MBC.
 class MBC {
 protected:
 
     std::vector<u8> m_rom;
     std::vector<u8> m_ram;
-    u8 m_rom_banks;
+    u16 m_rom_banks;
     u8 m_ram_banks;
 
     bool m_has_ram;
     bool m_has_battery;
 
+    u8 *m_rom_base[2];  //0x0000 - 0x3FFF and 0x4000 - 0x7FFF
+    u16 m_rom_bank[2];
+    u8 *m_ram_base;     //nullptr when RAM is disabled or missing
+
+    void map_rom(u16 bank0, u16 bank1);
+    void map_ram(bool enabled, u8 bank);
+
 public:
 
-    MBC(bool has_ram, bool has_battery) : m_has_ram(has_ram), m_has_battery(has_battery) { }
-    virtual ~MBC() { }
+    MBC(bool has_ram, bool has_battery) : m_has_ram(has_ram), m_has_battery(has_battery), m_rom_base{nullptr, nullptr}, m_rom_bank{0, 0}, m_ram_base(nullptr) { }
 
     bool in_address_space(u16 address);
 
-    virtual void init(u8 rom_banks, u8 ram_banks) = 0;
-    virtual void load_rom(u8 *rom_data) = 0;
-    virtual void write(u16 address, u8 value) = 0;
-    virtual u8 read(u16 address) = 0;
+    void load_rom(u8 *rom_data);
     void load_ram(u8 *ram_data);
 
+    u8 read_rom(u16 address) { return m_rom_base[address >> 14][address & 0x3FFF]; }
+    u8 read_ram(u16 address) { return m_ram_base != nullptr ? m_ram_base[address & 0x1FFF] : 0xff; }
+    void write_ram(u16 address, u8 value) { if(m_ram_base != nullptr) m_ram_base[address & 0x1FFF] = value; }
+
+    u16 rom_bank(u16 address) { return m_rom_bank[address >> 14]; }
+    u8* rom_pointer(u16 address) { return &m_rom_base[address >> 14][address & 0x3FFF]; }
+    u8* ram_pointer(u16 address) { return m_ram_base != nullptr ? &m_ram_base[address & 0x1FFF] : nullptr; }
+
     bool has_ram() { return m_has_ram; }
     bool has_battery() { return m_has_battery; }
 
@@ -76,35 +88,15 @@ public:
 };
 
 
-class Mapper {
-private:
-
-    MBC *m_mbc;
-
-public:
-
-    Mapper();
-    ~Mapper();
-
-    void create(u8 code, u8 rom_banks, u8 ram_banks, u8 *rom_data);
-    bool in_address_space(u16 address);
-    void write(u16 address, u8 value);
-    u8 read(u16 address);
-
-    MBC* get_mbc() { return m_mbc; }
-};
-
-
 //Behaves exactly as if there was no MBC at all. Only 2 banks of ROM, 32Kb, and optionally 1 bank of work RAM.
 class NoMBC : public MBC {
 public:
 
     NoMBC(bool has_ram, bool has_battery) : MBC(has_ram, has_battery) { }
 
-    void init(u8 rom_banks, u8 ram_banks) override;
-    void load_rom(u8 *rom_data) override;
-    void write(u16 address, u8 value) override;
-    u8 read(u16 address) override;
+    void init(u8 rom_banks, u8 ram_banks);
+    void write_register(u16, u8) { }
+    void update_banks();
 };
 
 
@@ -121,10 +113,9 @@ public:
 
     MBC1(bool has_ram, bool has_battery) : MBC(has_ram, has_battery), m_ram_enable(false), m_selected_bank(1), m_selected_bank2(0), m_mode(0) { }
 
-    void init(u8 rom_banks, u8 ram_banks) override;
-    void load_rom(u8 *rom_data) override;
-    void write(u16 address, u8 value) override;
-    u8 read(u16 address) override;
+    void init(u8 rom_banks, u8 ram_banks);
+    void write_register(u16 address, u8 value);
+    void update_banks();
 };
 
 
@@ -142,10 +133,9 @@ public:
 
     MBC3(bool has_ram, bool has_battery, bool has_timer) : MBC(has_ram, has_battery), m_has_timer(has_timer), m_ram_enable(true), m_selected_rom(1), m_selected_ram(0) { }
 
-    void init(u8 rom_banks, u8 ram_banks) override;
-    void load_rom(u8 *rom_data) override;
-    void write(u16 address, u8 value) override;
-    u8 read(u16 address) override;
+    void init(u8 rom_banks, u8 ram_banks);
+    void write_register(u16 address, u8 value);
+    void update_banks();
 
     bool has_timer() { return m_has_timer; }
 };
@@ -162,10 +152,36 @@ public:
 
     MBC5(bool has_ram, bool has_battery) : MBC(has_ram, has_battery), m_ram_enable(true), m_selected_rom(1), m_selected_ram(0) { }
 
-    void init(u8 rom_banks, u8 ram_banks) override;
-    void load_rom(u8 *rom_data) override;
-    void write(u16 address, u8 value) override;
-    u8 read(u16 address) override;
+    void init(u8 rom_banks, u8 ram_banks);
+    void write_register(u16 address, u8 value);
+    void update_banks();
+};
+
+
+//Picks the MBC once when the cartridge is loaded. The MBC lives inside the mapper as a variant, so there are no virtual calls,
+//and everything but register writes goes straight to the common MBC state.
+class Mapper {
+private:
+
+    std::variant<std::monostate, NoMBC, MBC1, MBC3, MBC5> m_mbcs;
+    MBC *m_mbc; //Whichever one is in m_mbcs
+
+    template<typename T>
+    void setup(T &mbc, u8 rom_banks, u8 ram_banks, u8 *rom_data);
+
+public:
+
+    Mapper();
+
+    void create(u8 code, u8 rom_banks, u8 ram_banks, u8 *rom_data);
+    bool in_address_space(u16 address);
+    void write(u16 address, u8 value);
+    u8 read(u16 address) { return address <= 0x7FFF ? m_mbc->read_rom(address) : m_mbc->read_ram(address); }
+    u16 rom_bank(u16 address) { return m_mbc->rom_bank(address); }
+    u8* rom_pointer(u16 address) { return m_mbc->rom_pointer(address); }
+    u8* ram_pointer(u16 address) { return m_mbc->ram_pointer(address); }
+
+    MBC* get_mbc() { return m_mbc; }
 };
 
 } //namespace sb
@@ -5,14 +5,17 @@
 #include "apu/APU.hpp"
 #include "Timer.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 
 namespace sb {
 
-Memory::Memory(CPU &cpu, PPU &ppu, APU &apu, Timer &timer, InputDevice &input_device) : m_cpu(cpu), m_ppu(ppu), m_apu(apu), m_timer(timer), m_input_device(input_device) {
+Memory::Memory(CPU &cpu, PPU &ppu, APU &apu, Timer &timer, Scheduler &scheduler, InputDevice &input_device) : m_cpu(cpu), m_ppu(ppu), m_apu(apu), m_timer(timer), 
+m_scheduler(scheduler), m_input_device(input_device) {
     reset();
+    m_scheduler.set_handler(SERIAL_TRANSFER, [&]() { finish_serial(); });
 
     m_input_device.register_callback([&] {
         m_input_device.get_input(m_io_regs[0]);
@@ -49,6 +52,7 @@ bool Memory::load_cart(const std::string &path) {
     m_cart.load(size, rom);
 
     m_mapper.create(m_cart.header.cart_type, m_cart.header.rom_size, m_cart.header.ram_size, rom);
+    map_cart_pages();
 
     delete[] rom;
 
@@ -90,16 +94,64 @@ Cartridge& Memory::get_cart() {
 }
 
 void Memory::reset() {
-    m_ie = 0xff;
     memset(m_io_regs, 0, 128);
+    map_pages();
+}
+
+//Work RAM and its echo never have side effects on reads, writes to Work RAM only need to tell the CPU in case it's code
+void Memory::map_pages() {
+    std::fill(std::begin(m_read_pages), std::end(m_read_pages), nullptr);
+    std::fill(std::begin(m_write_pages), std::end(m_write_pages), nullptr);
+
+    for(usize page = 0; page < 0x10; page++) {
+        m_read_pages[0xC0 + page] = m_write_pages[0xC0 + page] = &m_iwork_ram[page * 256];
+        m_read_pages[0xD0 + page] = m_write_pages[0xD0 + page] = &m_ework_ram[page * 256];
+        m_read_pages[0xE0 + page] = &m_iwork_ram[page * 256];
+        if(page < 0xE) m_read_pages[0xF0 + page] = &m_ework_ram[page * 256];
+    }
+
+    map_cart_pages();
+}
+
+//Has to be redone whenever the MBC might have switched banks, or the boot ROM gets unmapped. External RAM is left to
+//the slow path while it's disabled, so reads still give 0xFF.
+void Memory::map_cart_pages() {
+    if(m_mapper.get_mbc() == nullptr) {
+        return;
+    }
+
+    for(usize page = 0; page < 0x80; page++) {
+        m_read_pages[page] = m_mapper.rom_pointer(page << 8);
+    }
+
+    for(usize page = 0xA0; page < 0xC0; page++) {
+        m_read_pages[page] = m_write_pages[page] = m_mapper.ram_pointer(page << 8);
+    }
+
+    if(m_io_regs[0x50] == 0) {
+        m_read_pages[0] = m_boot_rom;
+    }
 }
 
 void Memory::write(u16 address, u8 value) {
+    u8 *page = m_write_pages[address >> 8];
+
+    if(page != nullptr) {
+        page[address & 0xff] = value;
+        m_cpu.code_written(address);
+    } else {
+        write_slow(address, value);
+    }
+}
+
+void Memory::write_slow(u16 address, u8 value) {
     //Do a binary search sort of thing
     if(address <= 0xFDFF) {
         if(address <= 0x7FFF) {
             //ROM
             m_mapper.write(address, value);
+            map_cart_pages();
+            m_cpu.flush_block(); //The bank the CPU is running from might have changed
         } else {
             u8 top_nibble = address >> 12;
 
@@ -112,9 +164,11 @@ void Memory::write(u16 address, u8 value) {
             } else if(in_range<u8>(top_nibble, 0xC, 0xC)) {
                 //Internal Work RAM
                 m_iwork_ram[address - 0xC000] = value;
+                m_cpu.code_written(address);
             } else if(in_range<u8>(top_nibble, 0xD, 0xD)) {
                 //External Work RAM
                 m_ework_ram[address - 0xD000] = value;
+                m_cpu.code_written(address);
             } else {
                 //Echo RAM
                 if(top_nibble == 0xE) {
@@ -122,6 +176,8 @@ void Memory::write(u16 address, u8 value) {
                 } else {
                     m_ework_ram[address - 0xF000] = value;
                 }
+
+                m_cpu.code_written(address - 0x2000);
             }
         }
     } else {
@@ -142,7 +198,14 @@ void Memory::write(u16 address, u8 value) {
                     m_input_device.get_input(m_io_regs[0]);
                 } else if(in_range<u8>(bottom_byte, 0x04, 0x07)) {
                     //Timers
+                    if(address == 0xFF04) {
+                        m_apu.reset_div(); //The frame sequencer runs off DIV
+                    }
+
                     m_timer.write(address, value);
+                } else if(address == 0xFF0F) {
+                    //Interrupt Flag
+                    m_cpu.write_if(value);
                 } else if(in_range<u8>(bottom_byte, 0x10, 0x3F)) {
                     //Sound
                     m_apu.write(address, value);
@@ -152,13 +215,18 @@ void Memory::write(u16 address, u8 value) {
                 } else {
                     //Everything else
                     m_io_regs[address - 0xFF00] = value;
+
+                    if(address == 0xFF50) {
+                        map_cart_pages(); //Boot ROM
+                    }
                 }
             } else if(in_range<u8>(bottom_byte, 0x80, 0xFE)) {
                 //High RAM
                 m_hram[address - 0xFF80] = value;
+                m_cpu.code_written(address);
             } else {
                 //IE
-                m_ie = value;
+                m_cpu.write_ie(value);
             }
         }
     }
@@ -166,10 +234,13 @@ void Memory::write(u16 address, u8 value) {
     if(address == 0xFF02 && value == 0x81) {
         char c = m_io_regs[1];
         std::printf("%c", c);
+
+        //8 bits at 8192 Hz using the internal clock
+        m_scheduler.schedule_in(SERIAL_TRANSFER, 8 * 512);
     }
 }
 
-u8 Memory::read(u16 address) {
+u8 Memory::read_slow(u16 address) {
     //Do a binary search sort of thing
     if(address <= 0xFDFF) {
         if(address <= 0x7FFF) {
@@ -224,6 +295,9 @@ u8 Memory::read(u16 address) {
                 } else if(in_range<u8>(bottom_byte, 0x04, 0x07)) {
                     //Timers
                     return m_timer.read(address);
+                } else if(address == 0xFF0F) {
+                    //Interrupt Flag
+                    return m_cpu.read_if();
                 } else if(in_range<u8>(bottom_byte, 0x10, 0x3F)) {
                     //Sound
                     return m_apu.read(address);
@@ -239,7 +313,7 @@ u8 Memory::read(u16 address) {
                 return m_hram[address - 0xFF80];
             } else {
                 //IE
-                return m_ie;
+                return m_cpu.read_ie();
             }
         }
     }
@@ -247,14 +321,11 @@ u8 Memory::read(u16 address) {
     return 0;
 }
 
-void Memory::dma_start(u8 value) {
-    m_dma_src = value << 8;
-    m_dma_dst = 0xFE00;
-}
-
-//Not sure this is entirely accurate, supposedly it takes more than 160 cycles
-void Memory::dma_step() {
-    m_ppu.write(m_dma_dst++, read(m_dma_src++));
+//There is never anything on the other end of the link cable, so only ones get shifted in
+void Memory::finish_serial() {
+    m_io_regs[1] = 0xff;
+    m_io_regs[2] &= 0x7f;
+    m_cpu.request_interrupt(SERIAL_INT);
 }
 
 } //namespace sb
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "common/Types.hpp"
 #include "Cartridge.hpp"
 #include "Mapper.hpp"
+#include "Scheduler.hpp"
 #include "../device/InputDevice.hpp"
 
 #include <string_view>
@@ -32,21 +33,30 @@ private:
                             //Unused        |          |  0xFEA0 - 0xFEFF  |  Unused (for some reason), Nintendo says area is prohibited
     u8 m_io_regs[128];      //IO Registers  |          |  0xFF00 - 0xFF7F  |  IO Registers
     u8 m_hram[127];         //High RAM      |          |  0xFF80 - 0xFFFE  |  High RAM
-    u8 m_ie;                //IE            |          |  0xFFFF - 0xFFFF  |  Interrupt Enable Register
+                            //IE            |          |  0xFFFF - 0xFFFF  |  Interrupt Enable Register, kept by the CPU
+
+    //Host pointers for each 256 byte page, nullptr means the access needs the slow path for its side effects
+    u8 *m_read_pages[256];
+    u8 *m_write_pages[256];
 
     Cartridge m_cart;
     CPU &m_cpu;
     PPU &m_ppu;
     APU &m_apu;
     Timer &m_timer;
+    Scheduler &m_scheduler;
     InputDevice &m_input_device;
 
-    u16 m_dma_src;
-    u16 m_dma_dst;
+    void finish_serial();
+
+    void map_pages();
+    void map_cart_pages();
+    void write_slow(u16 address, u8 value);
+    u8 read_slow(u16 address);
 
 public:
 
-    Memory(CPU &cpu, PPU &ppu, APU &apu, Timer &timer, InputDevice &input_device);
+    Memory(CPU &cpu, PPU &ppu, APU &apu, Timer &timer, Scheduler &scheduler, InputDevice &input_device);
     ~Memory();
 
     bool load_cart(const std::string &path);
@@ -56,10 +66,11 @@ public:
 
     void reset();
     void write(u16 address, u8 value);
-    u8 read(u16 address);
 
-    void dma_start(u8 value);
-    void dma_step();
+    u8 read(u16 address) {
+        u8 *page = m_read_pages[address >> 8];
+        return page != nullptr ? page[address & 0xff] : read_slow(address);
+    }
 
     void log_cpu();
 
@@ -1,43 +1,81 @@
 #include "Scheduler.hpp"
 #include "common/Log.hpp"
 
+#include <algorithm>
+
 
 namespace sb {
 
-//Determines which clock is lower and resets that to zero, then resets the other plus the difference
-void Scheduler::reset_clocks() {
-    if(cpu_clock.get_t() <= ppu_clock.get_t()) {
-        usize diff = ppu_clock.get_t() - cpu_clock.get_t();
-        cpu_clock.reset();
-        ppu_clock.reset();
-        ppu_clock.add_t(diff);
-    } else {
-        usize diff = cpu_clock.get_t() - ppu_clock.get_t();
-        ppu_clock.reset();
-        cpu_clock.reset();
-        cpu_clock.add_t(diff);
+Scheduler::Scheduler() {
+    reset();
+}
+
+void Scheduler::update_next_event() {
+    m_next_event = *std::min_element(m_events.begin(), m_events.end());
+}
+
+//Ticks everything up to the CPU's clock, stopping at each event along the way so they happen in the right order
+void Scheduler::catch_up() {
+    u64 target = clock.get_t();
+
+    while(m_now < target) {
+        u64 until = std::min(target, m_next_event);
+
+        if(until > m_now) {
+            m_tick(until - m_now);
+            m_now = until;
+        }
+
+        //Events can schedule more events, even for the same timestamp
+        while(m_next_event <= m_now) {
+            for(usize i = 0; i < EVENT_COUNT; i++) {
+                if(m_events[i] <= m_now) {
+                    m_events[i] = NO_EVENT;
+                    update_next_event();
+                    m_handlers[i]();
+                }
+            }
+        }
     }
 }
 
 void Scheduler::reset() {
-    cpu_clock.reset();
-    ppu_clock.reset();
+    clock.reset();
+    m_now = 0;
+    m_run_target = 0;
+    m_events.fill(NO_EVENT);
+    m_next_event = NO_EVENT;
 }
 
 //Run for at least that amount of cycles, it might go past it a bit
 void Scheduler::run_for(usize cycles) {
-    usize target = cpu_clock.get_t() + cycles;
-
-    while(cpu_clock.get_t() < target) {
-        //Determine which part is behind
-        if(cpu_clock.get_t() <= ppu_clock.get_t()) {
-            m_cpu_step();
-        } else {
-            m_ppu_step();
+    m_run_target = clock.get_t() + cycles;
+
+    while(clock.get_t() < m_run_target) {
+        m_cpu_step();
+        catch_up();
+    }
+}
+
+void Scheduler::schedule(EventType type, u64 timestamp) {
+    m_events[type] = timestamp;
+    update_next_event();
+}
+
+void Scheduler::cancel(EventType type) {
+    m_events[type] = NO_EVENT;
+    update_next_event();
+}
+
+//Pushes back everything that is pending, used to freeze the rest of the system while the CPU is stopped
+void Scheduler::delay_events(u64 cycles) {
+    for(u64 &event : m_events) {
+        if(event != NO_EVENT) {
+            event += cycles;
         }
     }
 
-    reset_clocks();
+    update_next_event();
 }
 
 } //namespace sb
\ No newline at end of file
@@ -3,52 +3,98 @@
 
 #include "common/Types.hpp"
 
+#include <algorithm>
+#include <array>
 #include <functional>
+#include <limits>
 
 
 namespace sb {
 
-class CPU;
-class PPU;
-
-
 class Clock {
 private:
 
-    usize m_t_count = 0;
-    usize m_m_count = 0;
+    u64 m_t_count = 0;
+    u64 m_m_count = 0;
 
 public:
 
     void reset() { m_t_count = 0; m_m_count = 0; }
-    void add_t(usize cycles) { m_t_count += cycles; m_m_count = m_t_count / 4; }
-    void add_m(usize cycles) { m_m_count += cycles; m_t_count = m_m_count * 4; }
-    usize get_t() { return m_t_count; }
-    usize get_m() { return m_m_count; }
+    void add_t(u64 cycles) { m_t_count += cycles; m_m_count = m_t_count / 4; }
+    void add_m(u64 cycles) { m_m_count += cycles; m_t_count = m_m_count * 4; }
+    u64 get_t() { return m_t_count; }
+    u64 get_m() { return m_m_count; }
+};
+
+
+//Things that happen at a known point in time, each type can only be pending once
+enum EventType : u8 {
+    PPU_MODE,            //The PPU reaching the end of a mode or a line
+    PPU_HBLANK,          //The earliest the pixel FIFO could finish the line, so the PPU gets caught up in time for HBlank
+    DMA_END,             //OAM DMA finishing and giving OAM back to the CPU
+    SERIAL_TRANSFER,     //The last bit of a serial transfer being shifted out
+    TIMER_OVERFLOW,      //TIMA wrapping around and requesting an interrupt
+    APU_FRAME_SEQUENCER, //The frame sequencer's bit of DIV falling
+    APU_FLUSH,           //The channels being caught up and the finished samples sent to the audio device
+    EVENT_COUNT
 };
 
+constexpr u64 NO_EVENT = std::numeric_limits<u64>::max();
 
 using StepFunction = std::function<void()>;
+using TickFunction = std::function<void(u64 cycles)>;
+using EventFunction = std::function<void()>;
 
-//A simple relative scheduler that tries to keep the cpu and ppu in sync cycles-wise.
+//Keeps a single global timestamp that the CPU drives forward. After every instruction the rest of the system is caught up to it,
+//components that still need to run every cycle are ticked in one batch, and everything else just waits for its next event.
 class Scheduler {
 private:
 
     StepFunction m_cpu_step;
-    StepFunction m_ppu_step;
+    TickFunction m_tick;
+
+    std::array<u64, EVENT_COUNT> m_events;
+    std::array<EventFunction, EVENT_COUNT> m_handlers;
+    u64 m_next_event;
+    u64 m_now; //What everything besides the CPU has been caught up to
+    u64 m_run_target; //Where the current run_for stops
 
-    void reset_clocks();
+    void update_next_event();
+    void catch_up();
 
 public:
 
-    Clock cpu_clock;
-    Clock ppu_clock;
+    Clock clock; //Driven by the CPU
+
+    Scheduler();
 
     void reset();
     void run_for(usize cycles);
 
+    void schedule(EventType type, u64 timestamp);
+    void schedule_in(EventType type, u64 cycles) { schedule(type, m_now + cycles); }
+    void cancel(EventType type);
+    void delay_events(u64 cycles);
+    bool pending(EventType type) { return m_events[type] != NO_EVENT; }
+    u64 now() { return m_now; }
+    u64 until_next_stop() { return std::min(m_next_event, m_run_target) - clock.get_t(); }
+
+    //Lets the CPU carry on after an instruction without a whole catch_up. As long as nothing is due and the CPU isn't
+    //stopped, moving now up to the clock is all catch_up would've done.
+    bool advance() {
+        u64 time = clock.get_t();
+
+        if(time >= m_next_event || time >= m_run_target) {
+            return false;
+        }
+
+        m_now = time;
+        return true;
+    }
+
     void set_cpu_step(StepFunction cpu_step) { m_cpu_step = cpu_step; }
-    void set_ppu_step(StepFunction ppu_step) { m_ppu_step = ppu_step; }
+    void set_tick(TickFunction tick) { m_tick = tick; }
+    void set_handler(EventType type, EventFunction handler) { m_handlers[type] = handler; }
 };
 
 } //namespace sb
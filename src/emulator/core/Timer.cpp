@@ -1,77 +1,115 @@
 #include "Timer.hpp"
 
-#define GB_CLOCK_FREQ 4194304
+#include <algorithm>
 
 
 namespace sb {
 
-static constexpr u32 cycles_per_tick[4] = {GB_CLOCK_FREQ / 4096, GB_CLOCK_FREQ / 262144, GB_CLOCK_FREQ / 65536, GB_CLOCK_FREQ / 16384};
-
-Timer::Timer(CPU &cpu) : m_cpu(cpu) {
+Timer::Timer(CPU &cpu, Scheduler &scheduler) : m_cpu(cpu), m_scheduler(scheduler) {
+    m_scheduler.set_handler(TIMER_OVERFLOW, [&]() { sync(); schedule_overflow(); });
     reset();
 }
 
-void Timer::step() {
-    m_old_internal_counter = m_internal_counter;
-    m_internal_counter++;
+//Applies every TIMA increment up to now. TIMA goes up on every falling edge of the selected counter bit, which is every
+//time the counter reaches a multiple of the period.
+void Timer::sync() {
+    u64 now = m_scheduler.now();
 
-    //4-cycle delay where tima reads 00
-    m_overflow_count++;
-    if(m_overflow_count > 3) {
-        m_overflow_count = 0;
-        m_tima_overflow = false;
-    }
+    if(enabled()) {
+        u64 start = counter(m_tima_time);
+        u64 increments = counter(now) / period() - start / period();
+        u64 next_edge = m_tima_time + (start / period() + 1) * period() - start;
 
-    //Increment 
-    const u8 counter_bits[4] = {9, 3, 5, 7};
-    bool old_bit = m_old_internal_counter >> (counter_bits[m_tac & 3]) & 1;
-    bool current_bit = m_internal_counter >> (counter_bits[m_tac & 3]) & 1;
-    if((m_tac >> 2 & 1) && old_bit && !current_bit) {
-        m_tima++;
+        while(increments > 0) {
+            u64 step = std::min<u64>(increments, 0x100 - m_tima);
+            increments -= step;
 
-        if(m_tima == 0) {
-            m_tima_overflow = true;
-            m_overflow_count = 0;
+            if(m_tima + step > 0xff) {
+                //TIMA overflowed on this step's last increment
+                m_overflow_time = next_edge + (step - 1) * period();
+                m_tima = m_tma;
+                m_cpu.request_interrupt(TIMER_INT);
+            } else {
+                m_tima += step;
+            }
 
-            m_tima = m_tma;
-            m_cpu.request_interrupt(TIMER_INT);
+            next_edge += step * period();
         }
     }
+
+    m_tima_time = now;
+}
+
+void Timer::schedule_overflow() {
+    if(!enabled()) {
+        m_scheduler.cancel(TIMER_OVERFLOW);
+        return;
+    }
+
+    u64 now = m_scheduler.now();
+    u64 next_edge = now + period() - counter(now) % period();
+    m_scheduler.schedule(TIMER_OVERFLOW, next_edge + (0xff - m_tima) * period());
 }
 
 void Timer::reset() {
-    m_internal_counter = 0;
+    m_base_time = m_scheduler.now();
+    m_tima_time = m_base_time;
+    m_overflow_time = NO_EVENT;
     m_tima = 0;
     m_tma = 0;
     m_tac = 0;
+
+    schedule_overflow();
 }
 
 void Timer::write(u16 address, u8 value) {
-    u8 old;
-    
+    sync();
+
     switch(address) {
-        case 0xFF04 : m_internal_counter = 0;
+        case 0xFF04 : m_base_time = m_scheduler.now();
         break;
         case 0xFF05 : m_tima = value;
         break;
         case 0xFF06 : m_tma = value;
         break;
-        case 0xFF07 : 
-        old = m_tac;
-        m_tac = value; m_tac |= 0b11111000;
+        case 0xFF07 : m_tac = value; m_tac |= 0b11111000;
         break;
         default : break;
     }
+
+    schedule_overflow();
 }
 
 u8 Timer::read(u16 address) {
+    sync();
+
     switch(address) {
-        case 0xFF04 : return m_internal_counter >> 8;
-        case 0xFF05 : if(!m_tima_overflow) return m_tima; else return 0;
+        case 0xFF04 : return div_at(m_scheduler.now());
+        case 0xFF05 : if(m_overflow_time == NO_EVENT || m_scheduler.now() - m_overflow_time >= 4) return m_tima; else return 0;
         case 0xFF06 : return m_tma;
         case 0xFF07 : return m_tac;
         default : return 0xff;
     }
 }
 
+//When a bit of the internal counter next goes from 1 to 0, at or after the given time. The counter being reset by a
+//write to DIV isn't counted, since it depends on what the counter was before.
+u64 Timer::next_falling_edge(u8 bit, u64 time) {
+    u64 period = 2 << bit;
+    u64 value = counter(time);
+    u64 edge = value == 0 ? period : (value + period - 1) / period * period;
+
+    return time + (edge - value);
+}
+
+//Freezes the timer while the CPU is stopped
+void Timer::delay(u64 cycles) {
+    m_base_time += cycles;
+    m_tima_time += cycles;
+
+    if(m_overflow_time != NO_EVENT) {
+        m_overflow_time += cycles;
+    }
+}
+
 } //namespace sb
\ No newline at end of file
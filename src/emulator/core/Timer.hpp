@@ -3,33 +3,49 @@
 
 #include "common/Types.hpp"
 #include "cpu/CPU.hpp"
+#include "Scheduler.hpp"
 
 #include <chrono>
 
 
 namespace sb {
 
+//DIV and TIMA are worked out from the time instead of being ticked, the only thing that's scheduled is the next overflow
 class Timer {
 private:
 
-    u16 m_old_internal_counter;
-    u16 m_internal_counter; //Div is the upper 8-bits of this internal counter
-    bool m_tima_overflow;
-    u8 m_overflow_count;
+    u64 m_base_time; //When the internal counter was last 0, DIV is the upper 8-bits of it
+
+    u64 m_tima_time;     //When TIMA was last brought up to date
+    u64 m_overflow_time; //When TIMA last overflowed, it reads 00 for 4 cycles after
     u8 m_tima;
     u8 m_tma;
     u8 m_tac;
 
     CPU &m_cpu;
+    Scheduler &m_scheduler;
+
+    //Not wrapped to 16-bits, so the falling edges between two times can be counted by dividing
+    u64 counter(u64 time) { return time - m_base_time; }
+    u32 period() { return 1 << (counter_bits[m_tac & 3] + 1); }
+    bool enabled() { return m_tac >> 2 & 1; }
+
+    void sync();
+    void schedule_overflow();
+
+    static constexpr u8 counter_bits[4] = {9, 3, 5, 7};
 
 public:
 
-    Timer(CPU &cpu);
+    Timer(CPU &cpu, Scheduler &scheduler);
 
-    void step();
     void reset();
     void write(u16 address, u8 value);
     u8 read(u16 address);
+
+    u8 div_at(u64 time) { return counter(time) >> 8; }
+    u64 next_falling_edge(u8 bit, u64 time);
+    void delay(u64 cycles);
 };
 
 } //namespace sb
@@ -3,9 +3,41 @@
 
 namespace sb {
 
-APU::APU(Timer &timer, AudioDevice &audio_device) : m_timer(timer), m_audio_device(audio_device), m_sample_counter(CYCLES_PER_SAMPLE) { }
+APU::APU(Timer &timer, Scheduler &scheduler, AudioDevice &audio_device) : m_timer(timer), m_scheduler(scheduler), m_audio_device(audio_device) {
+    m_scheduler.set_handler(APU_FRAME_SEQUENCER, [&]() {
+        sync();
+        clock_frame_sequencer();
+        m_scheduler.schedule(APU_FRAME_SEQUENCER, m_timer.next_falling_edge(FRAME_SEQUENCER_BIT, m_scheduler.now() + 1));
+    });
+    m_scheduler.set_handler(APU_FLUSH, [&]() {
+        flush();
+        m_scheduler.schedule_in(APU_FLUSH, CYCLES_PER_FLUSH);
+    });
+}
 
 void APU::reset() {
+    m_synced = m_scheduler.now();
+
+    //Silence is the lowest level, like it always was with the averaged samples
+    m_left.set_rates(CLOCK_SPEED, m_audio_device.sample_rate());
+    m_right.set_rates(CLOCK_SPEED, m_audio_device.sample_rate());
+    m_left.clear(m_synced, -32767);
+    m_right.clear(m_synced, -32767);
+
+    for(ChannelOutput &output : m_outputs) {
+        output.reset(m_left, m_right);
+    }
+
+    power_off();
+
+    m_nr52 = 0;
+    m_fs = 0;
+
+    m_scheduler.cancel(APU_FRAME_SEQUENCER);
+    m_scheduler.schedule_in(APU_FLUSH, CYCLES_PER_FLUSH);
+}
+
+void APU::power_off() {
     m_pulse1.reset();
     m_pulse2.reset();
     m_wave.reset();
@@ -13,9 +45,13 @@ void APU::reset() {
 
     m_nr50 = 0;
     m_nr51 = 0;
+    update_gains();
 }
 
 void APU::write(u16 address, u8 value) {
+    //Everything up to now has to be heard with the old values
+    sync();
+
     if(in_range<u16>(address, 0xFF10, 0xFF14)) {
         m_pulse1.write(address, value);
     } else if(in_range<u16>(address, 0xFF16, 0xFF19)) {
@@ -27,18 +63,22 @@ void APU::write(u16 address, u8 value) {
     }
 
     switch(address) {
-        case 0xFF24 : m_nr50 = value;
+        case 0xFF24 : m_nr50 = value; update_gains();
         break;
-        case 0xFF25 : m_nr51 = value;
+        case 0xFF25 : m_nr51 = value; update_gains();
         break;
-        case 0xFF26 : m_nr52 = value & 0x80;
+        case 0xFF26 :
+            //Turning sound on, the frame sequencer only runs while it's on
+            if((value & 0x80) != 0 && (m_nr52 & 0x80) == 0) {
+                m_scheduler.schedule(APU_FRAME_SEQUENCER, m_timer.next_falling_edge(FRAME_SEQUENCER_BIT, m_scheduler.now()));
+            }
+
+            m_nr52 = value & 0x80;
+
             //Turning sound off
             if((value & 0x80) == 0) {
-                m_pulse1.reset();
-                m_pulse2.reset();
-                m_wave.reset();
-                m_noise.reset();
-                reset();
+                m_scheduler.cancel(APU_FRAME_SEQUENCER);
+                power_off();
             }
         break;
     }
@@ -64,164 +104,129 @@ u8 APU::read(u16 address) {
     return 0;
 }
 
-void APU::step() {
-    //Sound ON/OFF
-    if((m_nr52 & 0x80) != 0) {
-        //4th bit (zero indexed) of DIV determines when to increment the frame sequencer, equivilent to 8192 T-cycles or 512 Hz
-        u8 div = m_timer.read(0xFF04);
-
-        //If falling edge, step the frame sequencer
-        if(((m_last_div >> 4) & 1) && !((div >> 4) & 1)) {
-            switch(m_fs) {
-                case 0 : 
-                    m_pulse1.clock_length(); 
-                    m_pulse2.clock_length(); 
-                    m_wave.clock_length(); 
-                    m_noise.clock_length();
-                break;
-                case 1 :
-                break;
-                case 2 : 
-                    m_pulse1.clock_sweep();
-                    m_pulse1.clock_length(); 
-                    m_pulse2.clock_length(); 
-                    m_wave.clock_length(); 
-                    m_noise.clock_length();
-                break;
-                case 3 :
-                break;
-                case 4 : 
-                    m_pulse1.clock_length(); 
-                    m_pulse2.clock_length(); 
-                    m_wave.clock_length(); 
-                    m_noise.clock_length();
-                break;
-                case 5 : 
-                break;
-                case 6 : 
-                    m_pulse1.clock_sweep(); 
-                    m_pulse1.clock_length(); 
-                    m_pulse2.clock_length(); 
-                    m_wave.clock_length(); 
-                    m_noise.clock_length();
-                break;
-                case 7 : 
-                    m_pulse1.clock_volume(); 
-                    m_pulse2.clock_volume();
-                    m_noise.clock_volume();
-                break;
-            }
-
-            m_fs = (m_fs + 1) % 8;
-        }
-
-        m_last_div = div;
-
-        //Step channels
-        m_pulse1.step();
-        m_pulse2.step();
-        m_wave.step();
-        m_noise.step();
+//Writing to DIV resets the whole internal counter, which is a falling edge if the frame sequencer's bit was set
+void APU::reset_div() {
+    if((m_nr52 & 0x80) == 0) {
+        return;
     }
 
-    //Average samples, fixes an aliasing issue (found in Link's Awakening's intro)
-    m_average_sample_r += get_so1_sample() / 15.0f; //Put the samples between 0 and 1
-    m_average_sample_l += get_so2_sample() / 15.0f;
-
-    if(--m_sample_counter <= 0) {
-        //There are bits in the NR50 register that allows the cartridge to 
-        //supply a 5th sound channel, but no game ever used it. So I won't implement it.
-        float right_vol = m_nr50 & 7;       //Right is sound output terminal 01
-        float left_vol = (m_nr50 >> 4) & 7; //Left is sound output terminal 02
-
-        m_average_sample_r /= (float)CYCLES_PER_SAMPLE;
-        m_average_sample_l /= (float)CYCLES_PER_SAMPLE;
+    u64 now = m_scheduler.now();
+    bool falling = (m_timer.div_at(now - 1) >> 4) & 1;
+    m_scheduler.schedule(APU_FRAME_SEQUENCER, falling ? now : now + (2 << FRAME_SEQUENCER_BIT));
+}
 
-        m_average_sample_r *= right_vol / 7.0f;
-        m_average_sample_l *= left_vol / 7.0f;
+//Freezes the channels while the CPU is stopped
+void APU::delay(u64 cycles) {
+    m_synced += cycles;
+    m_left.delay(cycles);
+    m_right.delay(cycles);
+}
 
-        //Put between -1 and 1
-        m_average_sample_r = m_average_sample_r * 2 - 1;
-        m_average_sample_l = m_average_sample_l * 2 - 1;
+//Runs the channels up to now. Anything that changes what they output, like register writes and the frame sequencer,
+//syncs first, so the channels can run a whole stretch at once and only have to report when their amplitude changes.
+void APU::sync() {
+    u32 cycles = m_scheduler.now() - m_synced;
 
-        m_audio_device.push_sample(m_average_sample_l * 32767, m_average_sample_r * 32767);
-        m_sample_counter = CYCLES_PER_SAMPLE;
-        m_average_sample_r = m_average_sample_l = 0;
+    //The channels are frozen while sound is off, but they keep outputting whatever they were at
+    if(cycles != 0 && (m_nr52 & 0x80) != 0) {
+        m_pulse1.run(m_synced, cycles, m_outputs[0]);
+        m_pulse2.run(m_synced, cycles, m_outputs[1]);
+        m_wave.run(m_synced, cycles, m_outputs[2]);
+        m_noise.run(m_synced, cycles, m_outputs[3]);
     }
+
+    m_synced = m_scheduler.now();
 }
 
-//Mix sample for right speaker
-float APU::get_so1_sample() {
-    float sample = 0;
-    u8 output_channels = 0;
-    bool enabled_channels[4];
+//Every channel sent to an output terminal has the same weight, scaled so all of them at full amplitude and the terminal
+//at full volume covers the whole 16-bit range
+void APU::update_gains() {
+    //There are bits in the NR50 register that allows the cartridge to 
+    //supply a 5th sound channel, but no game ever used it. So I won't implement it.
+    u8 right_vol = m_nr50 & 7;       //Right is sound output terminal 01
+    u8 left_vol = (m_nr50 >> 4) & 7; //Left is sound output terminal 02
+    u8 right_channels = 0, left_channels = 0;
 
     for(int i = 0; i < 4; i++) {
-        enabled_channels[i] = (m_nr51 >> i) & 1;
+        right_channels += (m_nr51 >> i) & 1;
+        left_channels += (m_nr51 >> (i + 4)) & 1;
     }
 
-    //Pulse Channel 1
-    if(enabled_channels[0]) {
-        output_channels++;
-        sample += m_pulse1.get_amplitude();
-    }
+    u32 right_scale = 7 * 15 * right_channels;
+    u32 left_scale = 7 * 15 * left_channels;
 
-    //Pulse Channel 2
-    if(enabled_channels[1]) {
-        output_channels++;
-        sample += m_pulse2.get_amplitude();
-    }
+    for(int i = 0; i < 4; i++) {
+        s32 right = (m_nr51 >> i) & 1 ? (65534 * right_vol + right_scale / 2) / right_scale : 0;
+        s32 left = (m_nr51 >> (i + 4)) & 1 ? (65534 * left_vol + left_scale / 2) / left_scale : 0;
 
-    //Wave Channel 3
-    if(enabled_channels[2]) {
-        output_channels++;
-        sample += m_wave.get_amplitude();
+        m_outputs[i].set_gains(m_synced, left, right);
     }
+}
 
-    //Noise Channel 4
-    if(enabled_channels[3]) {
-        output_channels++;
-        sample += m_noise.get_amplitude();
+void APU::clock_frame_sequencer() {
+    switch(m_fs) {
+        case 0 : 
+            m_pulse1.clock_length(); 
+            m_pulse2.clock_length(); 
+            m_wave.clock_length(); 
+            m_noise.clock_length();
+        break;
+        case 1 :
+        break;
+        case 2 : 
+            m_pulse1.clock_sweep();
+            m_pulse1.clock_length(); 
+            m_pulse2.clock_length(); 
+            m_wave.clock_length(); 
+            m_noise.clock_length();
+        break;
+        case 3 :
+        break;
+        case 4 : 
+            m_pulse1.clock_length(); 
+            m_pulse2.clock_length(); 
+            m_wave.clock_length(); 
+            m_noise.clock_length();
+        break;
+        case 5 : 
+        break;
+        case 6 : 
+            m_pulse1.clock_sweep(); 
+            m_pulse1.clock_length(); 
+            m_pulse2.clock_length(); 
+            m_wave.clock_length(); 
+            m_noise.clock_length();
+        break;
+        case 7 : 
+            m_pulse1.clock_volume(); 
+            m_pulse2.clock_volume();
+            m_noise.clock_volume();
+        break;
     }
 
-    return sample / output_channels;
+    m_fs = (m_fs + 1) % 8;
 }
 
-//Mix sample for left speaker
-float APU::get_so2_sample() {
-    float sample = 0;
-    u8 output_channels = 0;
-    bool enabled_channels[4];
-
-    for(int i = 0; i < 4; i++) {
-        enabled_channels[i] = ((m_nr51 >> 4) >> i) & 1;
-    }
-
-    //Pulse Channel 1
-    if(enabled_channels[0]) {
-        output_channels++;
-        sample += m_pulse1.get_amplitude();
-    }
+//Sends every finished sample to the audio device
+void APU::flush() {
+    sync();
+    m_left.end_frame(m_synced);
+    m_right.end_frame(m_synced);
 
-    //Pulse Channel 2
-    if(enabled_channels[1]) {
-        output_channels++;
-        sample += m_pulse2.get_amplitude();
-    }
+    s16 samples[256 * 2];
 
-    //Wave Channel 3
-    if(enabled_channels[2]) {
-        output_channels++;
-        sample += m_wave.get_amplitude();
+    while(m_left.samples_avail() > 0) {
+        usize count = std::min<usize>(m_left.samples_avail(), 256);
+        m_left.read_samples(samples, count, 2);
+        m_right.read_samples(samples + 1, count, 2);
+        m_audio_device.push_samples(samples, count);
     }
 
-    //Noise Channel 4
-    if(enabled_channels[3]) {
-        output_channels++;
-        sample += m_noise.get_amplitude();
+    //Only safe to change once the frame has ended
+    if(m_audio_device.sample_rate() != m_left.sample_rate()) {
+        m_left.set_rates(CLOCK_SPEED, m_audio_device.sample_rate());
+        m_right.set_rates(CLOCK_SPEED, m_audio_device.sample_rate());
     }
-
-    return sample / output_channels;
 }
 
 } //namespace sb
\ No newline at end of file
@@ -3,14 +3,18 @@
 
 #include "emulator/device/AudioDevice.hpp"
 #include "emulator/core/Timer.hpp"
+#include "emulator/core/Scheduler.hpp"
 #include "PulseChannel.hpp"
 #include "WaveChannel.hpp"
 #include "NoiseChannel.hpp"
+#include "BlipBuffer.hpp"
 
 
 namespace sb {
 
-constexpr u8 CYCLES_PER_SAMPLE = 95; //4Mhz / 44100 Hz
+constexpr u32 CLOCK_SPEED = 4194304;
+constexpr u32 CYCLES_PER_FLUSH = 8192; //Samples are also sent at the end of every run_for, this just keeps the buffers small
+constexpr u8 FRAME_SEQUENCER_BIT = 12; //Bit 4 of DIV, its falling edge steps the frame sequencer at 512 Hz
 
 class APU {
 private:
@@ -50,24 +54,30 @@ private:
     u8 m_nr51;
     u8 m_nr52;
 
-    float m_average_sample_l, m_average_sample_r;
-    u8 m_sample_counter;
+    BlipBuffer m_left, m_right; //Sound output terminals 02 and 01
+    ChannelOutput m_outputs[4];
     u8 m_fs; //Frame sequencer
-    u8 m_last_div;
+    u64 m_synced; //What the channels have been run up to
     Timer &m_timer;
+    Scheduler &m_scheduler;
     AudioDevice &m_audio_device;
 
+    void sync();
+    void update_gains();
+    void clock_frame_sequencer();
+    void power_off();
+
 public:
 
-    APU(Timer &timer, AudioDevice &audio_device);
+    APU(Timer &timer, Scheduler &scheduler, AudioDevice &audio_device);
 
     void reset();
     void write(u16 address, u8 value);
     u8 read(u16 address);
 
-    void step();
-    float get_so1_sample();
-    float get_so2_sample();
+    void reset_div();
+    void delay(u64 cycles);
+    void flush();
 };
 
 } //namespace sb
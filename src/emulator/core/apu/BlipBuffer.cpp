@@ -0,0 +1,120 @@
+#include "BlipBuffer.hpp"
+#include "common/Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+
+namespace sb {
+
+constexpr u32 BLIP_PHASES = 1 << BLIP_PHASE_BITS;
+constexpr double BLIP_CUTOFF = 0.9; //Fraction of the Nyquist frequency that's kept, leaves room for the window's rolloff
+
+using BlipKernel = std::array<std::array<s32, BLIP_WIDTH>, BLIP_PHASES>;
+
+//A windowed sinc impulse for every phase, the running sum of it is the band-limited step. Each phase is rounded so it
+//adds up to exactly one step, otherwise the level would drift a little with every change.
+static BlipKernel make_kernel() {
+    BlipKernel kernel;
+    constexpr double PI = 3.14159265358979323846;
+
+    for(u32 phase = 0; phase < BLIP_PHASES; phase++) {
+        double taps[BLIP_WIDTH];
+        double total = 0;
+
+        for(u32 i = 0; i < BLIP_WIDTH; i++) {
+            //Distance from the step's center, which sits between the two middle taps when the phase is 0
+            double x = (double)i - (BLIP_WIDTH / 2 - 1) - (double)phase / BLIP_PHASES;
+            double sinc = x == 0 ? 1.0 : std::sin(PI * BLIP_CUTOFF * x) / (PI * BLIP_CUTOFF * x);
+            double window = 0.42 + 0.5 * std::cos(PI * x / (BLIP_WIDTH / 2)) + 0.08 * std::cos(2 * PI * x / (BLIP_WIDTH / 2)); //Blackman
+
+            taps[i] = sinc * window;
+            total += taps[i];
+        }
+
+        s32 sum = 0;
+        u32 center = 0;
+
+        for(u32 i = 0; i < BLIP_WIDTH; i++) {
+            kernel[phase][i] = std::lround(taps[i] / total * (1 << BLIP_KERNEL_BITS));
+            sum += kernel[phase][i];
+
+            if(kernel[phase][i] > kernel[phase][center]) {
+                center = i;
+            }
+        }
+
+        //Whatever rounding lost goes on the biggest tap, where it matters least
+        kernel[phase][center] += (1 << BLIP_KERNEL_BITS) - sum;
+    }
+
+    return kernel;
+}
+
+static const BlipKernel STEP_KERNEL = make_kernel();
+
+
+//Can be called between frames to change the rate without losing anything
+void BlipBuffer::set_rates(u32 clock_rate, double sample_rate) {
+    m_sample_rate = sample_rate;
+    m_factor = (u64)((sample_rate / clock_rate) * ((u64)1 << BLIP_TIME_BITS) + 0.5);
+
+    //A tenth of a second, a lot more than there ever is between two frames
+    usize size = sample_rate / 10 + BLIP_WIDTH;
+
+    if(m_buffer.size() < size) {
+        m_buffer.resize(size, 0);
+    }
+}
+
+void BlipBuffer::clear(u64 time, s32 level) {
+    std::fill(m_buffer.begin(), m_buffer.end(), 0);
+    m_offset = 0;
+    m_start_time = time;
+    m_integrator = level * (1 << BLIP_KERNEL_BITS);
+}
+
+void BlipBuffer::add_delta(u64 time, s32 delta) {
+    u64 position = m_offset + (time - m_start_time) * m_factor;
+    usize index = position >> BLIP_TIME_BITS;
+    u32 phase = (position >> (BLIP_TIME_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+
+    if(index + BLIP_WIDTH > m_buffer.size()) {
+        LOG_ERROR("[BLIP] : Buffer overflow, samples have to be read more often!");
+        return;
+    }
+
+    s32 *out = &m_buffer[index];
+    const s32 *taps = STEP_KERNEL[phase].data();
+
+    for(u32 i = 0; i < BLIP_WIDTH; i++) {
+        out[i] += taps[i] * delta;
+    }
+}
+
+//Everything before the time is final and can be read
+void BlipBuffer::end_frame(u64 time) {
+    m_offset += (time - m_start_time) * m_factor;
+    m_start_time = time;
+}
+
+//Writes every stride-th element of out, so two buffers can be read straight into an interleaved stereo stream
+void BlipBuffer::read_samples(s16 *out, usize count, usize stride) {
+    count = std::min({count, samples_avail(), m_buffer.size() - BLIP_WIDTH});
+
+    for(usize i = 0; i < count; i++) {
+        m_integrator += m_buffer[i];
+        out[i * stride] = std::clamp(m_integrator >> BLIP_KERNEL_BITS, -32768, 32767);
+    }
+
+    //Move the changes that are still spreading into samples that aren't finished yet to the front
+    usize remaining = std::min(samples_avail() + BLIP_WIDTH, m_buffer.size()) - count;
+    std::memmove(m_buffer.data(), m_buffer.data() + count, remaining * sizeof(s32));
+    std::fill(m_buffer.begin() + remaining, m_buffer.begin() + remaining + count, 0);
+
+    m_offset -= (u64)count << BLIP_TIME_BITS;
+}
+
+} //namespace sb
\ No newline at end of file
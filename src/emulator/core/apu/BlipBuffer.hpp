@@ -0,0 +1,87 @@
+#ifndef BLIP_BUFFER_HPP
+#define BLIP_BUFFER_HPP
+
+#include "common/Types.hpp"
+
+#include <vector>
+
+
+namespace sb {
+
+constexpr u32 BLIP_TIME_BITS = 32;   //Fractional bits of a position in output samples
+constexpr u32 BLIP_PHASE_BITS = 5;   //How many sub-sample positions the step is precomputed at, as a power of 2
+constexpr u32 BLIP_WIDTH = 16;       //Output samples a step is spread over
+constexpr u32 BLIP_KERNEL_BITS = 12; //A whole step adds up to 1 << BLIP_KERNEL_BITS
+
+//Band-limited step synthesis. Instead of sampling the output every cycle, only the changes in its level are recorded
+//along with when they happen. Each change is spread over the next few output samples as a band-limited step, so
+//nothing above the output's Nyquist frequency aliases back down, and reading just adds the changes back up.
+class BlipBuffer {
+private:
+
+    std::vector<s32> m_buffer;
+    u64 m_factor;     //Output samples per clock cycle
+    double m_sample_rate;
+    u64 m_offset;     //Where m_start_time falls in the buffer
+    u64 m_start_time; //Time of the last end_frame, changes can't be added before it
+    s32 m_integrator;
+
+public:
+
+    void set_rates(u32 clock_rate, double sample_rate);
+    double sample_rate() { return m_sample_rate; }
+    void clear(u64 time, s32 level);
+    void delay(u64 cycles) { m_start_time += cycles; }
+
+    void add_delta(u64 time, s32 delta);
+    void end_frame(u64 time);
+    usize samples_avail() { return m_offset >> BLIP_TIME_BITS; }
+    void read_samples(s16 *out, usize count, usize stride);
+};
+
+
+//Connects a channel to both output terminals, turning changes in its amplitude into deltas scaled by how loud the
+//channel is on each terminal
+class ChannelOutput {
+private:
+
+    BlipBuffer *m_left;
+    BlipBuffer *m_right;
+    s32 m_left_gain;
+    s32 m_right_gain;
+    u8 m_amplitude;
+
+public:
+
+    void reset(BlipBuffer &left, BlipBuffer &right) {
+        m_left = &left;
+        m_right = &right;
+        m_left_gain = m_right_gain = 0;
+        m_amplitude = 0;
+    }
+
+    void set_amplitude(u64 time, u8 amplitude) {
+        if(amplitude != m_amplitude) {
+            s32 delta = amplitude - m_amplitude;
+            m_amplitude = amplitude;
+
+            if(m_left_gain != 0) m_left->add_delta(time, delta * m_left_gain);
+            if(m_right_gain != 0) m_right->add_delta(time, delta * m_right_gain);
+        }
+    }
+
+    void set_gains(u64 time, s32 left, s32 right) {
+        if(m_amplitude != 0) {
+            if(left != m_left_gain) m_left->add_delta(time, (left - m_left_gain) * m_amplitude);
+            if(right != m_right_gain) m_right->add_delta(time, (right - m_right_gain) * m_amplitude);
+        }
+
+        m_left_gain = left;
+        m_right_gain = right;
+    }
+};
+
+} //namespace sb
+
+
+#endif //BLIP_BUFFER_HPP
\ No newline at end of file
@@ -23,8 +23,9 @@ void NoiseChannel::write(u16 address, u8 value) {
             m_length_timer = 64 - (value & 63);
         break;
         case 0xFF21 : m_nr42 = value;
-            //Check if DAC is enabled (All 5 high bits are not zero)
+            //Check if DAC is enabled (All 5 high bits are not zero), turning it off turns the channel off too
             m_dac_enabled = (value & 0xF8) != 0;
+            m_enabled = m_enabled && m_dac_enabled;
         break;
         case 0xFF22 : m_nr43 = value;
         break;
@@ -49,7 +50,8 @@ u8 NoiseChannel::read(u16 address) {
 }
 
 void NoiseChannel::trigger() {
-    m_enabled = true;
+    //The channel only turns on if its DAC is on
+    m_enabled = m_dac_enabled;
 
     if(m_length_timer == 0) {
         m_length_timer = 64;
@@ -65,28 +67,60 @@ void NoiseChannel::trigger() {
     m_period_timer = m_nr42 & 7;
 }
 
-void NoiseChannel::step() {
+void NoiseChannel::clock_lfsr() {
+    //Some weird stuff to make the white noise
+    u8 xor_result = (m_lfsr & 1) ^ ((m_lfsr >> 1) & 1); //XOR first two bits
+    m_lfsr = (m_lfsr >> 1) | (xor_result << 14); //Store XOR-result into the 14th bit
+
+    //This makes the noise more regular, to resemble a tone more
+    if((m_nr43 >> 3) & 1) {
+        m_lfsr &= ~(1 << 6);
+        m_lfsr |= xor_result << 6; //Also store the XOR-result into the 6th bit
+    }
+}
+
+//Same as the pulse channels, passes on every change in its amplitude
+void NoiseChannel::run(u64 time, u32 cycles, ChannelOutput &output) {
     if(m_enabled && m_dac_enabled) {
         m_output_vol = m_current_vol;
     } else {
         m_output_vol = 0;
     }
 
-    if(--m_freq_timer <= 0) {
-        m_freq_timer = DIVISORS[m_nr43 & 7] << (m_nr43 >> 4);
+    //The reload is kept to 16-bits like the timer itself
+    u32 period = (u16)(DIVISORS[m_nr43 & 7] << (m_nr43 >> 4));
+    period = period != 0 ? period : 0x10000;
+    u32 timer = m_freq_timer != 0 ? m_freq_timer : 0x10000;
 
-        //Some weird stuff to make the white noise
-        u8 xor_result = (m_lfsr & 1) ^ ((m_lfsr >> 1) & 1); //XOR first two bits
-        m_lfsr = (m_lfsr >> 1) | (xor_result << 14); //Store XOR-result into the 14th bit
+    output.set_amplitude(time, get_amplitude());
 
-        //This makes the noise more regular, to resemble a tone more
-        if((m_nr43 >> 3) & 1) {
-            m_lfsr &= ~(1 << 6);
-            m_lfsr |= xor_result << 6; //Also store the XOR-result into the 6th bit
+    //Off, as it always is with the DAC off. Trigger resets the LFSR and the timer, so there's nothing to keep going
+    if(!m_enabled) {
+        return;
+    }
+
+    //Silent, so only the LFSR has to be kept going
+    if(m_output_vol == 0) {
+        while(cycles >= timer) {
+            clock_lfsr();
+            cycles -= timer;
+            timer = period;
         }
 
+        m_freq_timer = timer - cycles;
+        return;
+    }
 
+    while(cycles >= timer) {
+        time += timer;
+        cycles -= timer;
+        timer = period;
+
+        clock_lfsr();
+        output.set_amplitude(time - 1, get_amplitude());
     }
+
+    m_freq_timer = timer - cycles;
 }
 
 void NoiseChannel::clock_volume() {
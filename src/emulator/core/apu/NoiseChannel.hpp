@@ -2,6 +2,7 @@
 #define NOISE_CHANNEL_HPP
 
 #include "common/Types.hpp"
+#include "BlipBuffer.hpp"
 
 
 namespace sb {
@@ -16,16 +17,17 @@ private:
     u8 m_nr43; //FF22 | Polynomial counter
     u8 m_nr44; //FF23 | Counter/consecutive
 
-    u16 m_lfsr; //Linear Feedback Shift Register
-    u16 m_freq_timer;
+    u16 m_lfsr = 0; //Linear Feedback Shift Register
+    u16 m_freq_timer = 0;
     u8 m_length_timer;
     u8 m_period_timer;
-    u8 m_current_vol;
-    u8 m_output_vol;
+    u8 m_current_vol = 0;
+    u8 m_output_vol = 0;
     bool m_enabled;
     bool m_dac_enabled;
 
     void trigger();
+    void clock_lfsr();
 
 public:
 
@@ -33,7 +35,7 @@ public:
     void write(u16 address, u8 value);
     u8 read(u16 address);
 
-    void step();
+    void run(u64 time, u32 cycles, ChannelOutput &output);
     void clock_volume();
     void clock_length();
 
@@ -29,8 +29,9 @@ void PulseChannel::write(u16 address, u8 value) {
         break;
         case 0xFF12 :
         case 0xFF17 : m_nrx2 = value;
-            //Check if DAC enabled
+            //Check if DAC enabled, turning it off turns the channel off too
             m_dac_enabled = (value & 0xF8) != 0;
+            m_enabled = m_enabled && m_dac_enabled;
         break;
         case 0xFF13 :
         case 0xFF18 : m_nrx3 = value;
@@ -63,7 +64,8 @@ u8 PulseChannel::read(u16 address) {
 }
 
 void PulseChannel::trigger() {
-    m_enabled = true;
+    //The channel only turns on if its DAC is on
+    m_enabled = m_dac_enabled;
 
     if(m_length_timer == 0) {
         m_length_timer = 64;
@@ -110,7 +112,9 @@ u16 PulseChannel::calculate_freq() {
     return new_freq;
 }
 
-void PulseChannel::step() {
+//Runs the channel for a number of cycles starting at the given time, and passes on every change in its amplitude. The
+//registers can't change in between, so the output only moves when the frequency timer runs out.
+void PulseChannel::run(u64 time, u32 cycles, ChannelOutput &output) {
     //Don't output sound when disabled
     if(m_enabled && m_dac_enabled) {
         m_output_vol = m_current_vol;
@@ -118,11 +122,34 @@ void PulseChannel::step() {
         m_output_vol = 0;
     }
 
-    if(--m_freq_timer <= 0) {
-        u16 frequency = m_nrx3 | ((m_nrx4 & 7) << 8);
-        m_freq_timer = (2048 - frequency) * 4;
+    u32 period = (2048 - (m_nrx3 | ((m_nrx4 & 7) << 8))) * 4;
+    u32 timer = m_freq_timer != 0 ? m_freq_timer : 0x10000; //A timer that was never loaded wraps around first
+
+    output.set_amplitude(time, get_amplitude());
+
+    //Silent, so only the duty position has to be kept going
+    if(m_output_vol == 0) {
+        if(cycles < timer) {
+            m_freq_timer = timer - cycles;
+        } else {
+            cycles -= timer;
+            m_wave_duty_pos = (m_wave_duty_pos + 1 + cycles / period) % 8;
+            m_freq_timer = period - cycles % period;
+        }
+
+        return;
+    }
+
+    while(cycles >= timer) {
+        time += timer;
+        cycles -= timer;
+        timer = period;
+
         m_wave_duty_pos = (m_wave_duty_pos + 1) % 8;
+        output.set_amplitude(time - 1, get_amplitude());
     }
+
+    m_freq_timer = timer - cycles;
 }
 
 void PulseChannel::clock_sweep() {
@@ -2,6 +2,7 @@
 #define PULSE_CHANNEL_HPP
 
 #include "common/Types.hpp"
+#include "BlipBuffer.hpp"
 
 
 namespace sb {
@@ -17,12 +18,12 @@ private:
     u8 m_nrx3; //FF13 or FF18 | Frequency low
     u8 m_nrx4; //FF14 or FF19 | Frequency high
 
-    u8 m_wave_duty_pos;
-    u16 m_freq_timer;
+    u8 m_wave_duty_pos = 0;
+    u16 m_freq_timer = 0;
     u8 m_length_timer;
     u8 m_period_timer;
-    u8 m_current_vol;
-    u8 m_output_vol;
+    u8 m_current_vol = 0;
+    u8 m_output_vol = 0;
     u16 m_shadow_freq;
     u8 m_sweep_timer;
     bool m_sweep_enabled;
@@ -38,7 +39,7 @@ public:
     void write(u16 address, u8 value);
     u8 read(u16 address);
 
-    void step();
+    void run(u64 time, u32 cycles, ChannelOutput &output);
     void clock_sweep();
     void clock_volume();
     void clock_length();
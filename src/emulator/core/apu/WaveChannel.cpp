@@ -20,8 +20,9 @@ void WaveChannel::reset() {
 void WaveChannel::write(u16 address, u8 value) {
     switch(address) {
         case 0xFF1A : m_nr30 = value;
-            //Sound on/off
+            //Sound on/off, turning the DAC off turns the channel off too
             m_dac_enabled = value >> 7;
+            m_enabled = m_enabled && m_dac_enabled;
         break;
         case 0xFF1B : m_nr31 = value;
             //Reload length timer
@@ -61,7 +62,8 @@ u8 WaveChannel::read(u16 address) {
 }
 
 void WaveChannel::trigger() {
-    m_enabled = true;
+    //The channel only turns on if its DAC is on
+    m_enabled = m_dac_enabled;
 
     if(m_length_timer == 0) {
         m_length_timer = 256;
@@ -71,7 +73,8 @@ void WaveChannel::trigger() {
     m_wave_pos = 0;
 }
 
-void WaveChannel::step() {
+//Same as the pulse channels, passes on every change in its amplitude
+void WaveChannel::run(u64 time, u32 cycles, ChannelOutput &output) {
     //Don't output sound when disabled
     if(m_enabled && m_dac_enabled) {
         m_volume_shift = VOLUME_SHIFTS[(m_nr32 >> 5) & 3];
@@ -79,11 +82,34 @@ void WaveChannel::step() {
         m_volume_shift = 4;
     }
 
-    if(--m_freq_timer <= 0) {
-        u16 frequency = m_nr33 | ((m_nr34 & 7) << 8);
-        m_freq_timer = (2048 - frequency) * 2;
+    u32 period = (2048 - (m_nr33 | ((m_nr34 & 7) << 8))) * 2;
+    u32 timer = m_freq_timer != 0 ? m_freq_timer : 0x10000; //A timer that was never loaded wraps around first
+
+    output.set_amplitude(time, get_amplitude());
+
+    //Shifted all the way out, so only the position has to be kept going
+    if(m_volume_shift == 4) {
+        if(cycles < timer) {
+            m_freq_timer = timer - cycles;
+        } else {
+            cycles -= timer;
+            m_wave_pos = (m_wave_pos + 1 + cycles / period) % 32;
+            m_freq_timer = period - cycles % period;
+        }
+
+        return;
+    }
+
+    while(cycles >= timer) {
+        time += timer;
+        cycles -= timer;
+        timer = period;
+
         m_wave_pos = (m_wave_pos + 1) % 32;
+        output.set_amplitude(time - 1, get_amplitude());
     }
+
+    m_freq_timer = timer - cycles;
 }
 
 void WaveChannel::clock_length() {
@@ -2,6 +2,7 @@
 #define WAVE_CHANNEL_HPP
 
 #include "common/Types.hpp"
+#include "BlipBuffer.hpp"
 
 
 namespace sb {
@@ -16,12 +17,12 @@ private:
     u8 m_nr32;         //FF1C | Select output level
     u8 m_nr33;         //FF1D | Frequency low
     u8 m_nr34;         //FF1E | Frequency high
-    u8 m_wave_ram[16]; //FF30 - FF3F | Wave Pattern RAM
+    u8 m_wave_ram[16] = {}; //FF30 - FF3F | Wave Pattern RAM
 
-    u8 m_wave_pos;
-    u16 m_freq_timer;
+    u8 m_wave_pos = 0;
+    u16 m_freq_timer = 0;
     u16 m_length_timer;
-    u8 m_volume_shift;
+    u8 m_volume_shift = 4;
     bool m_enabled;
     bool m_dac_enabled;
 
@@ -33,7 +34,7 @@ public:
     void write(u16 address, u8 value);
     u8 read(u16 address);
 
-    void step();
+    void run(u64 time, u32 cycles, ChannelOutput &output);
     void clock_length();
 
     u8 get_amplitude();
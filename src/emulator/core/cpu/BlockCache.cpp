@@ -0,0 +1,98 @@
+#include "BlockCache.hpp"
+
+
+namespace sb {
+
+//Size in bytes of every opcode, 0xCB counts as 2 since the CB opcode acts like an operand
+static const u8 lengths[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, //0x00
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, //0x10
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, //0x20
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, //0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x70
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x90
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0xA0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0xB0
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, //0xC0
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, //0xD0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, //0xE0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1  //0xF0
+};
+
+u8 instruction_length(u8 opcode) {
+    return lengths[opcode];
+}
+
+//Jumps, calls, returns, restarts, halt and stop, plus the illegal opcodes so they still go through the slow path
+bool ends_block(u8 opcode) {
+    switch(opcode) {
+        case 0x10 : case 0x18 : case 0x20 : case 0x28 : case 0x30 : case 0x38 : case 0x76 :
+        case 0xC0 : case 0xC2 : case 0xC3 : case 0xC4 : case 0xC7 : case 0xC8 : case 0xC9 : case 0xCA : case 0xCC : case 0xCD : case 0xCF :
+        case 0xD0 : case 0xD2 : case 0xD3 : case 0xD4 : case 0xD7 : case 0xD8 : case 0xD9 : case 0xDA : case 0xDB : case 0xDC : case 0xDD : case 0xDF :
+        case 0xE3 : case 0xE4 : case 0xE7 : case 0xE9 : case 0xEB : case 0xEC : case 0xED : case 0xEF :
+        case 0xF4 : case 0xF7 : case 0xFC : case 0xFD : case 0xFF :
+            return true;
+        default :
+            return false;
+    }
+}
+
+CodeBlock* BlockCache::find(u16 bank, u16 address) {
+    auto block = m_blocks.find(key(bank, address));
+    return block != m_blocks.end() ? &block->second : nullptr;
+}
+
+//Blocks are never moved once they're in the map, so the pointer stays good until the block gets invalidated
+CodeBlock* BlockCache::insert(u16 bank, CodeBlock &&block) {
+    u32 block_key = key(bank, block.start);
+
+    if(block.start >= 0x8000) {
+        m_ram_blocks.push_back(block_key);
+
+        for(u32 address = block.start; address < block.end; address++) {
+            m_ram_code[address] = true;
+        }
+    }
+
+    return &(m_blocks[block_key] = std::move(block));
+}
+
+//Throws away every RAM block that covers the address
+void BlockCache::invalidate(u16 address) {
+    for(usize i = 0; i < m_ram_blocks.size();) {
+        CodeBlock &block = m_blocks[m_ram_blocks[i]];
+
+        if(address >= block.start && address < block.end) {
+            for(u32 byte = block.start; byte < block.end; byte++) {
+                m_ram_code[byte] = false;
+            }
+
+            m_blocks.erase(m_ram_blocks[i]);
+            m_ram_blocks[i] = m_ram_blocks.back();
+            m_ram_blocks.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    //Blocks can overlap, so mark whatever is still cached again
+    for(u32 block_key : m_ram_blocks) {
+        CodeBlock &block = m_blocks[block_key];
+
+        for(u32 byte = block.start; byte < block.end; byte++) {
+            m_ram_code[byte] = true;
+        }
+    }
+}
+
+void BlockCache::clear() {
+    m_blocks.clear();
+    m_ram_blocks.clear();
+    m_ram_code.reset();
+}
+
+} //namespace sb
\ No newline at end of file
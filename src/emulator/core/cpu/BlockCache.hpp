@@ -0,0 +1,67 @@
+#ifndef BLOCK_CACHE_HPP
+#define BLOCK_CACHE_HPP
+
+#include "common/Types.hpp"
+
+#include <bitset>
+#include <unordered_map>
+#include <vector>
+
+
+namespace sb {
+
+class CPU;
+struct NativeRun;
+
+using OpcodeHandler = u8 (CPU::*)(u8 first, u8 second);
+
+//An instruction with its operands already fetched, so running it doesn't have to go through memory again
+struct DecodedInstruction {
+    OpcodeHandler handler;
+    u16 address;
+    u8 opcode;
+    u8 first;
+    u8 second;
+    u8 length;
+    const NativeRun *native = nullptr; //Set on the first instruction of a compiled run
+};
+
+//A straight run of instructions, ending at the first one that can change the pc
+struct CodeBlock {
+    u16 start;
+    u16 end; //One past the last byte
+    std::vector<DecodedInstruction> instructions;
+    u32 hits = 0;
+    bool compiled = false;
+};
+
+constexpr usize MAX_BLOCK_LENGTH = 64;
+
+u8 instruction_length(u8 opcode);
+bool ends_block(u8 opcode);
+
+//Predecoded blocks keyed by (ROM bank, address). Code in Work RAM and High RAM is cached under bank 0 and has to be
+//thrown away whenever something writes over it.
+class BlockCache {
+private:
+
+    std::unordered_map<u32, CodeBlock> m_blocks;
+    std::vector<u32> m_ram_blocks;
+    std::bitset<0x10000> m_ram_code; //Which RAM bytes are part of a cached block
+
+    static u32 key(u16 bank, u16 address) { return (bank << 16) | address; }
+
+public:
+
+    CodeBlock* find(u16 bank, u16 address);
+    CodeBlock* insert(u16 bank, CodeBlock &&block);
+    void invalidate(u16 address);
+    void clear();
+
+    bool is_code(u16 address) { return m_ram_code[address]; }
+};
+
+} //namespace sb
+
+
+#endif //BLOCK_CACHE_HPP
\ No newline at end of file
@@ -1,67 +1,19 @@
 #include "CPU.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 namespace sb {
 
-CPU::CPU(Memory &mem, Clock &clock, GB_MODEL &model, bool skip_bootrom) : m_mem(mem), m_clock(clock), m_model(model), m_skip_bootrom(skip_bootrom) {
+//How many times a block has to be entered before it gets compiled
+constexpr u32 JIT_THRESHOLD = 16;
+
+CPU::CPU(Memory &mem, Clock &clock, GB_MODEL &model, bool skip_bootrom) : m_mem(mem), m_jit_lockstep(false), m_clock(clock), m_model(model), m_skip_bootrom(skip_bootrom) {
     reset();
 }
 
 CPU::~CPU() { }
 
-Reg& CPU::get_reg16(Reg16 reg) {
-    switch(reg) {
-        case AF : return af;
-        case BC : return bc;
-        case DE : return de;
-        case HL : return hl;
-        case SP : return sp;
-        case PC : return pc;
-        default : LOG_FATAL("Unknown 16-bit register!");
-    }
-}
-
-u8& CPU::get_reg8(Reg8 reg) {
-    switch(reg) {
-        case A : return af.hi;
-        case F : return af.lo;
-        case B : return bc.hi;
-        case C : return bc.lo;
-        case D : return de.hi;
-        case E : return de.lo;
-        case H : return hl.hi;
-        case L : return hl.lo;
-        default : LOG_FATAL("Unknown 16-bit register!");
-    }
-}
-
-bool CPU::get_flag(Flag flag) {
-    switch(flag) {
-        case ZERO : return af.lo >> 7 & 1;
-        case SUBTRACTION : return af.lo >> 6 & 1;
-        case HALF_CARRY : return af.lo >> 5 & 1;
-        case CARRY : return af.lo >> 4 & 1;
-        default : return 0;
-    }
-}
-
-void CPU::set_flags(u8 flag) {
-    af.lo |= flag;
-}
-
-void CPU::reset_flags(u8 flag) {
-    af.lo &= ~flag;
-}
-
-void CPU::set_flags_if(u8 flag, bool value) {
-    if(value) {
-        set_flags(flag);
-    } else {
-        reset_flags(flag);
-    }
-}
-
 void CPU::push(u16 address) {
     sp.value -= 2;
     m_mem.write(sp.value, address & 0xff);
@@ -75,14 +27,12 @@ u16 CPU::pop() {
 }
 
 void CPU::request_interrupt(Interrupt type) {
-    u8 int_f = m_mem.read(0xFF0F);
-    m_mem.write(0xFF0F, int_f | type);
+    write_if(m_if | type);
 }
 
 void CPU::service_interrupts() {
-    u8 int_f = m_mem.read(0xFF0F);
-    u8 int_e = m_mem.read(0xFFFF);
-    u8 ints = int_f & int_e & 0x1f;
+    u8 ints = m_pending;
+
     if(ints != 0) {
         m_halted = false; //Apparently IME doesn't matter to stop halting
         m_stopped = false;
@@ -100,7 +50,7 @@ void CPU::service_interrupts() {
                 if(enabled[i]) {
                     m_clock.add_m(5);
                     //Disable the interrupts
-                    m_mem.write(0xFF0F, int_f & ~(1 << i));
+                    write_if(m_if & ~(1 << i));
                     m_ime = false;
 
                     //Push current pc onto the stack
@@ -116,26 +66,341 @@ void CPU::service_interrupts() {
     }
 }
 
-void CPU::step() {
+//Gives back where the code at that address ends if it's somewhere that can be cached, or 0 if it isn't
+static u16 code_region_end(u16 address, bool boot_rom) {
+    if(address <= 0x3FFF) {
+        return boot_rom && address < 0x0100 ? 0 : 0x3FFF;
+    } else if(address <= 0x7FFF) {
+        return 0x7FFF;
+    } else if(in_range<u16>(address, 0xC000, 0xDFFF)) {
+        return 0xDFFF;
+    } else if(in_range<u16>(address, 0xFF80, 0xFFFE)) {
+        return 0xFFFE;
+    }
+
+    return 0;
+}
+
+CodeBlock* CPU::decode_block(u16 bank, u16 address) {
+    u16 region_end = code_region_end(address, m_mem.read(0xFF50) == 0);
+
+    if(region_end == 0) {
+        return nullptr;
+    }
+
+    CodeBlock block;
+    block.start = address;
+    u32 position = address;
+
+    while(block.instructions.size() < MAX_BLOCK_LENGTH) {
+        u8 opcode = m_mem.read(position);
+        u8 length = instruction_length(opcode);
+
+        //Operands in another region could be switched out from under the block
+        if(position + length - 1 > region_end) {
+            break;
+        }
+
+        u8 first = length > 1 ? m_mem.read(position + 1) : 0;
+        u8 second = length > 2 ? m_mem.read(position + 2) : 0;
+        block.instructions.push_back({m_opcodes[opcode], (u16)position, opcode, first, second, length});
+        position += length;
+
+        if(ends_block(opcode)) {
+            break;
+        }
+    }
+
+    if(block.instructions.empty()) {
+        return nullptr;
+    }
+
+    block.end = position;
+
+    return m_block_cache.insert(bank, std::move(block));
+}
+
+//Keeps going through the current block as long as the pc follows it, otherwise looks up or decodes the block starting at the pc
+const DecodedInstruction* CPU::fetch_decoded() {
+    if(m_block_pos != m_block_end && m_block_pos->address == pc.value) {
+        return m_block_pos++;
+    }
+
+    flush_block();
+
+    u16 bank = pc.value <= 0x7FFF ? m_mem.get_mapper().rom_bank(pc.value) : 0;
+    CodeBlock *block = m_block_cache.find(bank, pc.value);
+
+    if(block == nullptr) {
+        block = decode_block(bank, pc.value);
+
+        if(block == nullptr) {
+            return nullptr;
+        }
+    }
+
+    if(m_jit != nullptr && !block->compiled && ++block->hits >= JIT_THRESHOLD) {
+        compile_block(*block);
+    }
+
+    m_block_pos = block->instructions.data();
+    m_block_end = m_block_pos + block->instructions.size();
+
+    return m_block_pos++;
+}
+
+bool CPU::enable_jit(bool lockstep) {
+    if(!JIT::supported()) {
+        LOG_WARN("[JIT] : Not supported on this architecture, using the interpreter");
+        return false;
+    }
+
+    //Where every register is in the CPU, in the same order as Reg8 and Reg16
+    u8 *registers8[8] = {&af.hi, &af.lo, &bc.hi, &bc.lo, &de.hi, &de.lo, &hl.hi, &hl.lo};
+    Reg *registers16[6] = {&af, &bc, &de, &hl, &sp, &pc};
+    RegisterLayout layout;
+
+    for(usize i = 0; i < 8; i++) {
+        layout.reg8[i] = (u8*)registers8[i] - (u8*)this;
+    }
+
+    for(usize i = 0; i < 6; i++) {
+        layout.reg16[i] = (u8*)registers16[i] - (u8*)this;
+    }
+
+    m_jit = std::make_unique<JIT>(layout, &CPU::native_fallback);
+
+    if(!m_jit->allocated()) {
+        LOG_WARN("[JIT] : Couldn't get executable memory, using the interpreter");
+        m_jit.reset();
+        return false;
+    }
+
+    m_jit_lockstep = lockstep;
+    LOG_INFO("[JIT] : Enabled{}", lockstep ? ", checking against the interpreter" : "");
+
+    return true;
+}
+
+void CPU::native_fallback(CPU *cpu, u32 opcode, u32 first, u32 second) {
+    cpu->unpack_flags();
+    (cpu->*m_opcodes[opcode])(first, second);
+    cpu->pack_flags();
+}
+
+//Compiles every run of at least two register-only instructions in a hot block. Code in RAM is left to the interpreter
+//since it could be rewritten at any time.
+void CPU::compile_block(CodeBlock &block) {
+    block.compiled = true;
+
+    if(block.start > 0x7FFF) {
+        return;
+    }
+
+    std::vector<DecodedInstruction> &instructions = block.instructions;
+
+    for(usize start = 0; start < instructions.size();) {
+        u8 handler_cycles[MAX_BLOCK_LENGTH];
+        u8 length = 0;
+        u32 cycles = 0;
+
+        while(start + length < instructions.size()) {
+            const DecodedInstruction &instruction = instructions[start + length];
+
+            if(!is_native(instruction.opcode, instruction.first)) {
+                break;
+            }
+
+            //Let the handler tell how long it takes, then undo it
+            Reg before[6] = {af, bc, de, hl, sp, pc};
+            Flags flags = m_flags;
+            Clock clock = m_clock;
+            (this->*instruction.handler)(instruction.first, instruction.second);
+            u8 spent = m_clock.get_m() - clock.get_m();
+            af = before[0]; bc = before[1]; de = before[2]; hl = before[3]; sp = before[4]; pc = before[5];
+            m_flags = flags;
+            m_clock = clock;
+
+            if(cycles + 1 + spent > 0xff) {
+                break;
+            }
+
+            handler_cycles[length++] = spent;
+            cycles += 1 + spent;
+        }
+
+        if(length >= 2) {
+            const NativeRun *run = m_jit->compile(&instructions[start], length, handler_cycles);
+
+            if(run == nullptr) {
+                return;
+            }
+
+            instructions[start].native = run;
+        }
+
+        start += length > 0 ? length : 1;
+    }
+}
+
+//The first instruction's fetch was already counted by prepare. Native code works on F in af.lo like any other register.
+void CPU::run_native(const DecodedInstruction *instructions) {
+    const NativeRun &run = *instructions->native;
+    Reg before[6];
+    Clock clock;
+
+    pack_flags();
+
+    if(m_jit_lockstep) {
+        before[0] = af; before[1] = bc; before[2] = de; before[3] = hl; before[4] = sp; before[5] = pc;
+        clock = m_clock;
+    }
+
+    run.code(this);
+    unpack_flags();
+    m_clock.add_m(run.clock_cycles - 1);
+    pc.value = run.end;
+    m_block_pos = instructions + run.length;
+
+    if(m_jit_lockstep) {
+        verify_native(instructions, before, clock);
+    }
+}
+
+//Runs the same instructions through the interpreter and makes sure both end up in the same state
+void CPU::verify_native(const DecodedInstruction *instructions, const Reg (&before)[6], const Clock &clock) {
+    const NativeRun &run = *instructions->native;
+    Reg native[6] = {af, bc, de, hl, sp, pc};
+    u64 native_cycles = m_clock.get_m();
+
+    af = before[0]; bc = before[1]; de = before[2]; hl = before[3]; sp = before[4]; pc = before[5];
+    unpack_flags();
+    m_clock = clock;
+
+    for(usize i = 0; i < run.length; i++) {
+        if(i != 0) m_clock.add_m(1);
+        pc.value += 1 + (this->*instructions[i].handler)(instructions[i].first, instructions[i].second);
+    }
+
+    pack_flags();
+
+    Reg interpreted[6] = {af, bc, de, hl, sp, pc};
+
+    for(usize i = 0; i < 6; i++) {
+        if(native[i].value != interpreted[i].value || native_cycles != m_clock.get_m()) {
+            LOG_FATAL("[JIT] : Run at 0x{:04X} diverged from the interpreter!\n"
+            "Native:      AF={:04X} BC={:04X} DE={:04X} HL={:04X} SP={:04X} PC={:04X} cycles={}\n"
+            "Interpreter: AF={:04X} BC={:04X} DE={:04X} HL={:04X} SP={:04X} PC={:04X} cycles={}", before[5].value,
+            native[0].value, native[1].value, native[2].value, native[3].value, native[4].value, native[5].value, native_cycles,
+            af.value, bc.value, de.value, hl.value, sp.value, pc.value, m_clock.get_m());
+        }
+    }
+}
+
+//Nothing can happen to the CPU during a native run, so it has to wait if an interrupt is already waiting to be serviced
+bool CPU::interrupt_pending() {
+    return m_ime && m_pending != 0;
+}
+
+//Does everything for the next instruction up to calling its handler, which is left to whoever called this. Halts, native
+//runs and code that can't be cached are finished right here, and those give back nullptr since there's nothing left to do.
+const DecodedInstruction* CPU::prepare(Scheduler &scheduler) {
+    if(m_stopped) {
+        nop();
+        return nullptr;
+    }
+
+    if(m_halted) {
+        if(m_pending != 0) {
+            nop();
+        } else {
+            //Only an event can wake the CPU up, so skip to the first nop that would've gone past the next one
+            m_clock.add_m(std::max<u64>(1, (scheduler.until_next_stop() + 3) / 4));
+        }
+
+        return nullptr;
+    }
+
+    //How many T-cycles the CPU can run ahead before anything else could raise an interrupt
+    u64 native_budget = m_jit != nullptr ? scheduler.until_next_stop() : 0;
     m_clock.add_m(1);
-    m_opcode = m_mem.read(pc.value);
-    u8 op1 = m_mem.read(pc.value + 1);
-    u8 op2 = m_mem.read(pc.value + 2);
-    u8 num_operands = (this->*m_opcodes[m_opcode])(op1, op2);
 
-    pc.value += 1 + num_operands;
+    const DecodedInstruction *instruction = fetch_decoded();
+
+    if(instruction != nullptr && instruction->native != nullptr && instruction->native->cycles * 4 <= native_budget && !interrupt_pending()) {
+        run_native(instruction);
+        return nullptr;
+    }
 
-    //Logging
-    // if(m_mem.read(0xFF50) == 1 && log) {
-    //     m_log << fmt::format("A: {:02X} F: {:02X} B: {:02X} C: {:02X} D: {:02X} E: {:02X} H: {:02X} L: {:02X} SP: {:04X} PC: 00:{:04X} ({:02X} {:02X} {:02X} {:02X})\n",
-    //     af.hi, af.lo, bc.hi, bc.lo, de.hi, de.lo, hl.hi, hl.lo, sp.value, pc.value, m_mem.read(pc.value), m_mem.read(pc.value + 1), m_mem.read(pc.value + 2), m_mem.read(pc.value + 3));
-    // }
+    if(instruction == nullptr) {
+        //Code that can't be cached, like VRAM or external RAM
+        m_opcode = m_mem.read(pc.value);
+        u8 op1 = m_mem.read(pc.value + 1);
+        u8 op2 = m_mem.read(pc.value + 2);
+        pc.value += 1 + (this->*m_opcodes[m_opcode])(op1, op2);
+
+        return nullptr;
+    }
+
+    m_opcode = instruction->opcode;
+
+    return instruction;
 }
 
+//Gets to the next instruction with a handler still to call, or nullptr once something else in the system is due
+const DecodedInstruction* CPU::next_instruction(Scheduler &scheduler) {
+    const DecodedInstruction *instruction;
+
+    do {
+        service_interrupts();
+
+        if(m_stopped || !scheduler.advance()) {
+            return nullptr;
+        }
+
+        instruction = prepare(scheduler);
+    } while(instruction == nullptr);
+
+    return instruction;
+}
+
+#if !defined(SB_THREADED_DISPATCH)
+
+//Runs instructions until something else in the system is due, so the scheduler only has to step in between runs
+void CPU::run(Scheduler &scheduler) {
+    const DecodedInstruction *instruction = prepare(scheduler);
+
+    if(instruction == nullptr && (instruction = next_instruction(scheduler)) == nullptr) {
+        return;
+    }
+
+    do {
+        pc.value += 1 + (this->*instruction->handler)(instruction->first, instruction->second);
+
+        //Logging
+        // if(m_mem.read(0xFF50) == 1 && log) {
+        //     m_log << fmt::format("A: {:02X} F: {:02X} B: {:02X} C: {:02X} D: {:02X} E: {:02X} H: {:02X} L: {:02X} SP: {:04X} PC: 00:{:04X} ({:02X} {:02X} {:02X} {:02X})\n",
+        //     af.hi, af.lo, bc.hi, bc.lo, de.hi, de.lo, hl.hi, hl.lo, sp.value, pc.value, m_mem.read(pc.value), m_mem.read(pc.value + 1), m_mem.read(pc.value + 2), m_mem.read(pc.value + 3));
+        // }
+    } while((instruction = next_instruction(scheduler)) != nullptr);
+}
+
+#endif
+
 void CPU::reset() {
+    m_block_cache.clear();
+    flush_block();
+
+    if(m_jit != nullptr) {
+        m_jit->clear();
+    }
+
     m_ime = false;
     m_halted = false;
     m_stopped = false;
+    m_if = 0;
+    m_ie = 0xff;
+    m_pending = 0;
 
     if(m_skip_bootrom) {
         if(m_model == DMG) {
@@ -163,6 +428,8 @@ void CPU::reset() {
         sp.value = 0;
         pc.value = 0;
     }
+
+    unpack_flags();
 }
 
 } //namespace sb
\ No newline at end of file
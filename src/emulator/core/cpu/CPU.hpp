@@ -9,9 +9,12 @@
 #include "emulator/core/Scheduler.hpp"
 #include "emulator/core/GBCommon.hpp"
 #include "mnemonic.hpp"
+#include "BlockCache.hpp"
+#include "JIT.hpp"
 
 #include <array>
 #include <fstream>
+#include <memory>
 
 namespace sb {
 
@@ -41,6 +44,16 @@ enum Flag : u8 {
     ZERO = 128, SUBTRACTION = 64, HALF_CARRY = 32, CARRY = 16
 };
 
+//The flags the way the last instructions to touch them left them. Most instructions overwrite the flags of the one before,
+//so instead of building F every time only the values each flag comes from get stored, and F is put together when
+//something reads all of it
+struct Flags {
+    u8 zero;       //Z is set when this is 0, usually the result
+    bool subtract;
+    u8 half;       //H is bit 4, the operands and result xored together
+    bool carry;
+};
+
 enum ALU_Op {
     ADD, ADC, SUB, SBC, AND, XOR, OR, CP
 };
@@ -123,6 +136,8 @@ private:
     template<Reg16 reg>
     u8 push_r(u8 first, u8 second);
     
+    template<ALU_Op operation>
+    void alu(u8 n);
     template<ALU_Op operation, Reg8 other>
     constexpr u8 alu_a_r(u8 first, u8 second);
     template<ALU_Op operation>
@@ -199,30 +214,106 @@ private:
 
     //Registers
     Reg af, bc, de, hl, sp, pc;
+    Flags m_flags; //af.lo is only up to date after pack_flags
 
     //Memory and Cartridge
     Memory &m_mem;
     u8 m_opcode;
 
+    //Predecoded code, the block being run and the next instruction in it
+    BlockCache m_block_cache;
+    const DecodedInstruction *m_block_pos;
+    const DecodedInstruction *m_block_end;
+
+    //Recompiler, only used when it's turned on
+    std::unique_ptr<JIT> m_jit;
+    bool m_jit_lockstep;
+
     //Other stuff
     Clock &m_clock;
     bool m_ime;
     bool m_halted;
     bool m_stopped;
+    u8 m_if;      //0xFF0F | Interrupt Flag
+    u8 m_ie;      //0xFFFF | Interrupt Enable
+    u8 m_pending; //IF & IE, so checking for interrupts after every instruction doesn't have to go through memory
 
     GB_MODEL &m_model;
     bool m_skip_bootrom;
 
-    Reg& get_reg16(Reg16 reg);
-    u8& get_reg8(Reg8 reg);
-    bool get_flag(Flag flag);
-    void set_flags(u8 flag);
-    void reset_flags(u8 flag);
-    void set_flags_if(u8 flag, bool value);
+    //The register is a template argument everywhere, so these pick the member at compile time and a handler like
+    //ld_r_r<B, C> comes out as a single move instead of two switches
+    template<Reg16 reg>
+    Reg& get_reg16() {
+        if constexpr(reg == AF) return af;
+        else if constexpr(reg == BC) return bc;
+        else if constexpr(reg == DE) return de;
+        else if constexpr(reg == HL) return hl;
+        else if constexpr(reg == SP) return sp;
+        else return pc;
+    }
+
+    template<Reg8 reg>
+    u8& get_reg8() {
+        if constexpr(reg == A) return af.hi;
+        else if constexpr(reg == F) return af.lo;
+        else if constexpr(reg == B) return bc.hi;
+        else if constexpr(reg == C) return bc.lo;
+        else if constexpr(reg == D) return de.hi;
+        else if constexpr(reg == E) return de.lo;
+        else if constexpr(reg == H) return hl.hi;
+        else return hl.lo;
+    }
+
+    bool get_flag(Flag flag) {
+        switch(flag) {
+            case ZERO : return m_flags.zero == 0;
+            case SUBTRACTION : return m_flags.subtract;
+            case HALF_CARRY : return m_flags.half & 0x10;
+            case CARRY : return m_flags.carry;
+            default : return 0;
+        }
+    }
+
+    void set_flags_if(u8 flag, bool value) {
+        if(flag & ZERO) m_flags.zero = !value;
+        if(flag & SUBTRACTION) m_flags.subtract = value;
+        if(flag & HALF_CARRY) m_flags.half = value ? 0x10 : 0;
+        if(flag & CARRY) m_flags.carry = value;
+    }
+
+    void set_flags(u8 flag) { set_flags_if(flag, true); }
+    void reset_flags(u8 flag) { set_flags_if(flag, false); }
+
+    //Every flag at once, for arithmetic, Z and H are only worked out if they get read
+    void set_flags_lazy(u8 result, bool subtract, u8 half, bool carry) {
+        m_flags = {result, subtract, half, carry};
+    }
+
+    //Puts F together in af.lo for anything that reads it as a register, and takes it back apart after it's been written
+    void pack_flags() {
+        af.lo = get_flag(ZERO) << 7 | get_flag(SUBTRACTION) << 6 | get_flag(HALF_CARRY) << 5 | get_flag(CARRY) << 4;
+    }
+
+    void unpack_flags() {
+        m_flags = {(u8)(~af.lo & ZERO), (af.lo & SUBTRACTION) != 0, (u8)(af.lo >> 1 & 0x10), (af.lo & CARRY) != 0};
+    }
 
     void push(u16 address);
     u16 pop();
 
+    const DecodedInstruction* fetch_decoded();
+    CodeBlock* decode_block(u16 bank, u16 address);
+
+    void compile_block(CodeBlock &block);
+    void run_native(const DecodedInstruction *instructions);
+    void verify_native(const DecodedInstruction *instructions, const Reg (&before)[6], const Clock &clock);
+    static void native_fallback(CPU *cpu, u32 opcode, u32 first, u32 second);
+    bool interrupt_pending();
+
+    const DecodedInstruction* prepare(Scheduler &scheduler);
+    const DecodedInstruction* next_instruction(Scheduler &scheduler);
+
 
     //Logging
     std::ofstream m_log;
@@ -234,7 +325,12 @@ public:
 
     void service_interrupts();
     void request_interrupt(Interrupt type);
-    void step();
+
+    u8 read_if() { return m_if; }
+    u8 read_ie() { return m_ie; }
+    void write_if(u8 value) { m_if = value; m_pending = m_if & m_ie & 0x1f; }
+    void write_ie(u8 value) { m_ie = value; m_pending = m_if & m_ie & 0x1f; }
+    void run(Scheduler &scheduler);
     void reset();
     void nop() { m_clock.add_m(1); }
     void log_info();
@@ -244,7 +340,20 @@ public:
     void un_stop() { m_stopped = false; }
     usize get_m_cycles() { return m_clock.get_m(); }
 
+    bool enable_jit(bool lockstep);
+    bool jit_enabled() { return m_jit != nullptr; }
+
+    //Called by memory so cached code doesn't go stale
+    void flush_block() { m_block_pos = m_block_end = nullptr; }
+    void code_written(u16 address) {
+        if(m_block_cache.is_code(address)) {
+            m_block_cache.invalidate(address);
+            flush_block();
+        }
+    }
+
     friend class Memory;
+    friend class FlagFuzzer; //Checks the lazy flags against an eager reference, see src/test
 };
 
 } //namespace sb
@@ -36,30 +36,30 @@ u8 CPU::stop(u8 first, u8 second) {
 
 template<Reg8 dest, Reg8 src>
 u8 CPU::ld_r_r(u8 first, u8 second) {
-    //LOG_INFO("dest = {}, src = {}", get_reg8(dest), get_reg8(src));
-    get_reg8(dest) = get_reg8(src);
-    //LOG_INFO("dest = {}, src = {}", get_reg8(dest), get_reg8(src));
+    //LOG_INFO("dest = {}, src = {}", get_reg8<dest>(), get_reg8<src>());
+    get_reg8<dest>() = get_reg8<src>();
+    //LOG_INFO("dest = {}, src = {}", get_reg8<dest>(), get_reg8<src>());
     return 0;
 }
 
 template<Reg8 dest>
 u8 CPU::ld_r_hl(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg8(dest) = m_mem.read(hl.value);
+    get_reg8<dest>() = m_mem.read(hl.value);
     return 0;
 }
 
 template<Reg8 src>
 u8 CPU::ld_hl_r(u8 first, u8 second) {
     m_clock.add_m(1);
-    m_mem.write(hl.value, get_reg8(src));
+    m_mem.write(hl.value, get_reg8<src>());
     return 0;
 }
 
 template<Reg8 dest>
 u8 CPU::ld_r_n(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg8(dest) = first;
+    get_reg8<dest>() = first;
     return 1;
 }
 
@@ -72,21 +72,21 @@ u8 CPU::ld_hl_n(u8 first, u8 second) {
 template<Reg16 src_indirect>
 u8 CPU::ld_a_ri(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg8(A) = m_mem.read(get_reg16(src_indirect).value);
+    get_reg8<A>() = m_mem.read(get_reg16<src_indirect>().value);
     return 0;
 }
 
 template<Reg16 dest_indirect>
 u8 CPU::ld_ri_a(u8 first, u8 second) {
     m_clock.add_m(1);
-    m_mem.write(get_reg16(dest_indirect).value, get_reg8(A));
+    m_mem.write(get_reg16<dest_indirect>().value, get_reg8<A>());
     return 0;
 }
 
 template<s8 adder>
 u8 CPU::ld_hli_a(u8 first, u8 second) {
     m_clock.add_m(1);
-    m_mem.write(hl.value, get_reg8(A));
+    m_mem.write(hl.value, get_reg8<A>());
     hl.value += adder;
     return 0;
 }
@@ -94,7 +94,7 @@ u8 CPU::ld_hli_a(u8 first, u8 second) {
 template<s8 adder>
 u8 CPU::ld_a_hli(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg8(A) = m_mem.read(hl.value);
+    get_reg8<A>() = m_mem.read(hl.value);
     hl.value += adder;
     return 0;
 }
@@ -102,9 +102,9 @@ u8 CPU::ld_a_hli(u8 first, u8 second) {
 template<Reg16 dest>
 u8 CPU::ld_rr_nn(u8 first, u8 second) {
     m_clock.add_m(2);
-    //LOG_INFO("Reg={:04X}, 0x{:04X} = {:02X}", get_reg16(dest).value, to_u16(second, first), m_mem.read(to_u16(second, first)));
-    get_reg16(dest).value = to_u16(second, first); //Values stored in little-endian
-    //LOG_INFO("Reg={:04X}, 0x{:04X} = {:02X}", get_reg16(dest).value, to_u16(second, first), m_mem.read(to_u16(second, first)));
+    //LOG_INFO("Reg={:04X}, 0x{:04X} = {:02X}", get_reg16<dest>().value, to_u16(second, first), m_mem.read(to_u16(second, first)));
+    get_reg16<dest>().value = to_u16(second, first); //Values stored in little-endian
+    //LOG_INFO("Reg={:04X}, 0x{:04X} = {:02X}", get_reg16<dest>().value, to_u16(second, first), m_mem.read(to_u16(second, first)));
     return 2;
 }
 
@@ -119,7 +119,7 @@ u8 CPU::ld_nn_sp(u8 first, u8 second) {
 u8 CPU::read_io_n(u8 first, u8 second) {
     m_clock.add_m(2);
 
-    get_reg8(A) = m_mem.read(0xFF00 + first);
+    get_reg8<A>() = m_mem.read(0xFF00 + first);
 
     return 1;
 }
@@ -127,7 +127,7 @@ u8 CPU::read_io_n(u8 first, u8 second) {
 u8 CPU::write_io_n(u8 first, u8 second) {
     m_clock.add_m(2);
 
-    m_mem.write(0xFF00 + first, get_reg8(A));
+    m_mem.write(0xFF00 + first, get_reg8<A>());
 
     return 1;
 }
@@ -135,7 +135,7 @@ u8 CPU::write_io_n(u8 first, u8 second) {
 u8 CPU::read_io_c(u8 first, u8 second) {
     m_clock.add_m(1);
 
-    get_reg8(A) = m_mem.read(0xFF00 + get_reg8(C));
+    get_reg8<A>() = m_mem.read(0xFF00 + get_reg8<C>());
 
     return 0;
 }
@@ -143,7 +143,7 @@ u8 CPU::read_io_c(u8 first, u8 second) {
 u8 CPU::write_io_c(u8 first, u8 second) {
     m_clock.add_m(1);
 
-    m_mem.write(0xFF00 + get_reg8(C), get_reg8(A));
+    m_mem.write(0xFF00 + get_reg8<C>(), get_reg8<A>());
 
     return 0;
 }
@@ -151,7 +151,7 @@ u8 CPU::write_io_c(u8 first, u8 second) {
 u8 CPU::ld_nn_a(u8 first, u8 second) {
     m_clock.add_m(3);
 
-    m_mem.write(to_u16(second, first), get_reg8(A));
+    m_mem.write(to_u16(second, first), get_reg8<A>());
 
     return 2;
 }
@@ -159,7 +159,7 @@ u8 CPU::ld_nn_a(u8 first, u8 second) {
 u8 CPU::ld_a_nn(u8 first, u8 second) {
     m_clock.add_m(3);
 
-    get_reg8(A) = m_mem.read(to_u16(second, first));
+    get_reg8<A>() = m_mem.read(to_u16(second, first));
 
     return 2;
 }
@@ -340,8 +340,12 @@ u8 CPU::ret_if_not(u8 first, u8 second) {
 template<Reg16 reg>
 u8 CPU::pop_r(u8 first, u8 second) {
     m_clock.add_m(2);
-    get_reg16(reg).value = pop();
-    af.value &= 0xfff0; //Don't set flags that are impossible to set
+    get_reg16<reg>().value = pop();
+
+    if constexpr(reg == AF) {
+        af.lo &= 0xf0; //Don't set flags that are impossible to set
+        unpack_flags();
+    }
     
     return 0;
 }
@@ -349,263 +353,99 @@ u8 CPU::pop_r(u8 first, u8 second) {
 template<Reg16 reg>
 u8 CPU::push_r(u8 first, u8 second) {
     m_clock.add_m(3);
-    push(get_reg16(reg).value);
+
+    if constexpr(reg == AF) {
+        pack_flags();
+    }
+
+    push(get_reg16<reg>().value);
 
     return 0;
 }
 
-template<ALU_Op operation, Reg8 other>
-constexpr u8 CPU::alu_a_r(u8 first, u8 second) {
-    u8 old = 0;
-    u8 sum = 0;
-    u8 n = get_reg8(other); //So op a, a instructions work
+//H is the carry (or borrow) into bit 4, which is bit 4 of both operands and the result xored together
+template<ALU_Op operation>
+void CPU::alu(u8 n) {
+    u8 old = get_reg8<A>();
+    u16 result;
 
     switch(operation) {
         case ADD : 
-            old = get_reg8(A);
-            get_reg8(A) += n;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (n & 0xf);
-            set_flags_if(HALF_CARRY, (sum & 0x10) == 0x10);
-            set_flags_if(CARRY, get_reg8(A) < old);
+            result = old + n;
+            get_reg8<A>() = result;
+            set_flags_lazy(result, false, old ^ n ^ result, result > 0xff);
             break;
         case ADC :
-            old = get_reg8(A);
-            get_reg8(A) += n + get_flag(CARRY);
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (n & 0xf) + get_flag(CARRY);
-            set_flags_if(HALF_CARRY, sum > 0x0f);
-            set_flags_if(CARRY, old + n + get_flag(CARRY) > 0xff);
+            result = old + n + m_flags.carry;
+            get_reg8<A>() = result;
+            set_flags_lazy(result, false, old ^ n ^ result, result > 0xff);
             break;
         case SUB :
-            old = get_reg8(A);
-            get_reg8(A) -= n;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (n & 0xf));
-            set_flags_if(CARRY, old < n);
+            result = old - n;
+            get_reg8<A>() = result;
+            set_flags_lazy(result, true, old ^ n ^ result, result > 0xff);
             break;
         case SBC :
-            old = get_reg8(A);
-            get_reg8(A) -= (n + get_flag(CARRY));
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (n & 0xf) + get_flag(CARRY));
-            set_flags_if(CARRY, old < n + get_flag(CARRY));
+            result = old - n - m_flags.carry;
+            get_reg8<A>() = result;
+            set_flags_lazy(result, true, old ^ n ^ result, result > 0xff);
             break;
         case AND :
-            get_reg8(A) &= n;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | CARRY);
-            set_flags(HALF_CARRY);
+            get_reg8<A>() &= n;
+            set_flags_lazy(get_reg8<A>(), false, 0x10, false);
             break;
         case XOR :
-            get_reg8(A) ^= n;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
+            get_reg8<A>() ^= n;
+            set_flags_lazy(get_reg8<A>(), false, 0, false);
             break;
         case  OR :
-            get_reg8(A) |= n;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
+            get_reg8<A>() |= n;
+            set_flags_lazy(get_reg8<A>(), false, 0, false);
             break;
         case  CP :
-            old = get_reg8(A);
-            sum = get_reg8(A) - n;
-
-            set_flags_if(ZERO, sum == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (n & 0xf));
-            set_flags_if(CARRY, old < n);
+            result = old - n;
+            set_flags_lazy(result, true, old ^ n ^ result, result > 0xff);
             break;
     }
+}
 
+template<ALU_Op operation, Reg8 other>
+constexpr u8 CPU::alu_a_r(u8 first, u8 second) {
+    alu<operation>(get_reg8<other>());
     return 0;
 }
 
 template<ALU_Op operation>
 constexpr u8 CPU::alu_a_hli(u8 first, u8 second) {
-    u8 old = 0;
-    u8 sum = 0;
-    u8 hli = m_mem.read(hl.value);
-
-    switch(operation) {
-        case ADD : 
-            old = get_reg8(A);
-            get_reg8(A) += hli;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (hli & 0xf);
-            set_flags_if(HALF_CARRY, (sum & 0x10) == 0x10);
-            set_flags_if(CARRY, get_reg8(A) < old);
-            break;
-        case ADC :
-            old = get_reg8(A);
-            get_reg8(A) += hli + get_flag(CARRY);
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (hli & 0xf) + get_flag(CARRY);
-            set_flags_if(HALF_CARRY, sum > 0x0f);
-            set_flags_if(CARRY, old + hli + get_flag(CARRY) > 0xff);
-            break;
-        case SUB :
-            old = get_reg8(A);
-            get_reg8(A) -= hli;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (hli & 0xf));
-            set_flags_if(CARRY, old < hli);
-            break;
-        case SBC :
-            old = get_reg8(A);
-            get_reg8(A) -= (hli + get_flag(CARRY));
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (hli & 0xf) + get_flag(CARRY));
-            set_flags_if(CARRY, old < hli + get_flag(CARRY));
-            break;
-        case AND :
-            get_reg8(A) &= hli;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | CARRY);
-            set_flags(HALF_CARRY);
-            break;
-        case XOR :
-            get_reg8(A) ^= hli;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
-            break;
-        case  OR :
-            get_reg8(A) |= hli;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
-            break;
-        case  CP :
-            old = get_reg8(A);
-            sum = get_reg8(A) - hli;
-
-            set_flags_if(ZERO, sum == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (hli & 0xf));
-            set_flags_if(CARRY, old < hli);
-            break;
-    }
-
+    alu<operation>(m_mem.read(hl.value));
     return 0;
 }
 
 template<ALU_Op operation>
 constexpr u8 CPU::alu_a_n(u8 first, u8 second) {
-    u8 old = 0;
-    u8 sum = 0;
-
-    switch(operation) {
-        case ADD : 
-            old = get_reg8(A);
-            get_reg8(A) += first;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (first & 0xf);
-            set_flags_if(HALF_CARRY, (sum & 0x10) == 0x10);
-            set_flags_if(CARRY, get_reg8(A) < old);
-            break;
-        case ADC :
-            old = get_reg8(A);
-            get_reg8(A) += first + get_flag(CARRY);
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION);
-            sum = (old & 0xf) + (first & 0xf) + get_flag(CARRY);
-            set_flags_if(HALF_CARRY, sum > 0x0f);
-            set_flags_if(CARRY, old + first + get_flag(CARRY) > 0xff);
-            break;
-        case SUB :
-            old = get_reg8(A);
-            get_reg8(A) -= first;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (first & 0xf));
-            set_flags_if(CARRY, old < first);
-            break;
-        case SBC :
-            old = get_reg8(A);
-            get_reg8(A) -= (first + get_flag(CARRY));
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (first & 0xf) + get_flag(CARRY));
-            set_flags_if(CARRY, old < first + get_flag(CARRY));
-            break;
-        case AND :
-            get_reg8(A) &= first;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | CARRY);
-            set_flags(HALF_CARRY);
-            break;
-        case XOR :
-            get_reg8(A) ^= first;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
-            break;
-        case  OR :
-            get_reg8(A) |= first;
-
-            set_flags_if(ZERO, get_reg8(A) == 0);
-            reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
-            break;
-        case  CP :
-            old = get_reg8(A);
-            sum = get_reg8(A) - first;
-
-            set_flags_if(ZERO, sum == 0);
-            set_flags(SUBTRACTION);
-            set_flags_if(HALF_CARRY, (old & 0xf) < (first & 0xf));
-            set_flags_if(CARRY, old < first);
-            break;
-    }
-
+    alu<operation>(first);
     return 1;
 }
 
 template<Reg8 reg>
 u8 CPU::inc_r(u8 first, u8 second) {
-    get_reg8(reg)++;
+    u8 old = get_reg8<reg>()++;
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
-    reset_flags(SUBTRACTION);
-    set_flags_if(HALF_CARRY, (get_reg8(reg) & 0xf) == 0);
+    //Carry is left alone
+    m_flags.zero = get_reg8<reg>();
+    m_flags.subtract = false;
+    m_flags.half = old ^ 1 ^ get_reg8<reg>();
 
     return 0;
 }
 
 template<Reg8 reg>
 u8 CPU::dec_r(u8 first, u8 second) {
-    set_flags_if(HALF_CARRY, (get_reg8(reg) & 0xf) < 1);
+    u8 old = get_reg8<reg>()--;
 
-    get_reg8(reg)--;
-
-    set_flags_if(ZERO, get_reg8(reg) == 0);
-    set_flags(SUBTRACTION);
+    m_flags.zero = get_reg8<reg>();
+    m_flags.subtract = true;
+    m_flags.half = old ^ 1 ^ get_reg8<reg>();
 
     return 0;
 }
@@ -638,7 +478,7 @@ u8 CPU::dec_hli(u8 first, u8 second) {
 template<Reg16 reg>
 u8 CPU::inc_rr(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg16(reg).value += 1;
+    get_reg16<reg>().value += 1;
 
     return 0;
 }
@@ -646,7 +486,7 @@ u8 CPU::inc_rr(u8 first, u8 second) {
 template<Reg16 reg>
 u8 CPU::dec_rr(u8 first, u8 second) {
     m_clock.add_m(1);
-    get_reg16(reg).value -= 1;
+    get_reg16<reg>().value -= 1;
 
     return 0;
 }
@@ -655,12 +495,13 @@ template<Reg16 reg>
 u8 CPU::add_hl_rr(u8 first, u8 second) {
     m_clock.add_m(1);
     Reg old_hl = hl;
-    u16 rr = get_reg16(reg).value;
+    u16 rr = get_reg16<reg>().value;
     hl.value += rr;
 
-    reset_flags(SUBTRACTION);
-    set_flags_if(HALF_CARRY, (old_hl.value & 0xfff) + (rr & 0xfff) & 0x1000);
-    set_flags_if(CARRY, ((u32)old_hl.value + (u32)rr) & 0x10000);
+    //Zero is left alone, half carry is out of bit 11
+    m_flags.subtract = false;
+    m_flags.half = (old_hl.value ^ rr ^ hl.value) >> 8;
+    m_flags.carry = hl.value < rr;
 
     return 0;
 }
@@ -704,15 +545,15 @@ u8 CPU::daa(u8 first, u8 second) {
     //Adjust the A register so it's valid BCD
     if(!get_flag(SUBTRACTION)) {
         //Adjusts if half-carry or carry flag is set or if the result is out of bounds
-        if(get_flag(CARRY) || get_reg8(A) > 0x99) { get_reg8(A) += 0x60; set_flags(CARRY); }
-        if(get_flag(HALF_CARRY) || (get_reg8(A) & 0xf) > 0x09) { get_reg8(A) += 0x6; }
+        if(get_flag(CARRY) || get_reg8<A>() > 0x99) { get_reg8<A>() += 0x60; set_flags(CARRY); }
+        if(get_flag(HALF_CARRY) || (get_reg8<A>() & 0xf) > 0x09) { get_reg8<A>() += 0x6; }
     } else {
         //Adjust if half-carry or carry flag is set
-        if(get_flag(CARRY)) { get_reg8(A) -= 0x60; }
-        if(get_flag(HALF_CARRY)) { get_reg8(A) -= 0x6; }
+        if(get_flag(CARRY)) { get_reg8<A>() -= 0x60; }
+        if(get_flag(HALF_CARRY)) { get_reg8<A>() -= 0x6; }
     }
 
-    set_flags_if(ZERO, get_reg8(A) == 0);
+    set_flags_if(ZERO, get_reg8<A>() == 0);
     reset_flags(HALF_CARRY);
 
     return 0;
@@ -734,7 +575,7 @@ u8 CPU::prefix_cb(u8 first, u8 second) {
 template<u8 bit, Reg8 reg>
 void CPU::bit_n_r() {
     m_clock.add_m(1);
-    set_flags_if(ZERO, ((get_reg8(reg) >> bit) & 1) == 0);
+    set_flags_if(ZERO, ((get_reg8<reg>() >> bit) & 1) == 0);
     set_flags(HALF_CARRY);
     reset_flags(SUBTRACTION);
 }
@@ -751,7 +592,7 @@ template<u8 bit, Reg8 reg>
 void CPU::res_n_r() {
     m_clock.add_m(1);
 
-    get_reg8(reg) &= ~(1 << bit);
+    get_reg8<reg>() &= ~(1 << bit);
 }
 
 template<u8 bit>
@@ -765,7 +606,7 @@ template<u8 bit, Reg8 reg>
 void CPU::set_n_r() {
     m_clock.add_m(1);
 
-    get_reg8(reg) |= (1 << bit);
+    get_reg8<reg>() |= (1 << bit);
 }
 
 template<u8 bit>
@@ -776,8 +617,8 @@ void CPU::set_n_hli() {
 }
 
 u8 CPU::rla(u8 first, u8 second) {
-    u8 bit_7 = get_reg8(A) >> 7;
-    get_reg8(A) = get_reg8(A) << 1 | get_flag(CARRY);
+    u8 bit_7 = get_reg8<A>() >> 7;
+    get_reg8<A>() = get_reg8<A>() << 1 | get_flag(CARRY);
 
     set_flags_if(CARRY, bit_7);
     reset_flags(ZERO | SUBTRACTION | HALF_CARRY);
@@ -786,8 +627,8 @@ u8 CPU::rla(u8 first, u8 second) {
 }
 
 u8 CPU::rlca(u8 first, u8 second) {
-    u8 bit_7 = get_reg8(A) >> 7;
-    get_reg8(A) = get_reg8(A) << 1 | bit_7;
+    u8 bit_7 = get_reg8<A>() >> 7;
+    get_reg8<A>() = get_reg8<A>() << 1 | bit_7;
 
     set_flags_if(CARRY, bit_7);
     reset_flags(ZERO | SUBTRACTION | HALF_CARRY);
@@ -796,8 +637,8 @@ u8 CPU::rlca(u8 first, u8 second) {
 }
 
 u8 CPU::rra(u8 first, u8 second) {
-    u8 bit_0 = get_reg8(A) & 1;
-    get_reg8(A) = get_reg8(A) >> 1 | (get_flag(CARRY) << 7);
+    u8 bit_0 = get_reg8<A>() & 1;
+    get_reg8<A>() = get_reg8<A>() >> 1 | (get_flag(CARRY) << 7);
 
     set_flags_if(CARRY, bit_0);
     reset_flags(ZERO | SUBTRACTION | HALF_CARRY);
@@ -806,8 +647,8 @@ u8 CPU::rra(u8 first, u8 second) {
 }
 
 u8 CPU::rrca(u8 first, u8 second) {
-    u8 bit_0 = get_reg8(A) & 1;
-    get_reg8(A) = get_reg8(A) >> 1 | (bit_0) << 7;
+    u8 bit_0 = get_reg8<A>() & 1;
+    get_reg8<A>() = get_reg8<A>() >> 1 | (bit_0) << 7;
 
     set_flags_if(CARRY, bit_0);
     reset_flags(ZERO | SUBTRACTION | HALF_CARRY);
@@ -818,10 +659,10 @@ u8 CPU::rrca(u8 first, u8 second) {
 template<Reg8 reg>
 void CPU::rlc() {
     m_clock.add_m(1);
-    u8 bit_7 = get_reg8(reg) >> 7;
-    get_reg8(reg) = get_reg8(reg) << 1 | bit_7;
+    u8 bit_7 = get_reg8<reg>() >> 7;
+    get_reg8<reg>() = get_reg8<reg>() << 1 | bit_7;
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_7);
 }
@@ -839,10 +680,10 @@ void CPU::rlc_hli() {
 template<Reg8 reg>
 void CPU::rl() {
     m_clock.add_m(1);
-    u8 bit_7 = get_reg8(reg) >> 7;
-    get_reg8(reg) = get_reg8(reg) << 1 | get_flag(CARRY);
+    u8 bit_7 = get_reg8<reg>() >> 7;
+    get_reg8<reg>() = get_reg8<reg>() << 1 | get_flag(CARRY);
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_7);
 }
@@ -860,10 +701,10 @@ void CPU::rl_hli() {
 template<Reg8 reg>
 void CPU::rrc() {
     m_clock.add_m(1);
-    u8 bit_0 = get_reg8(reg) & 1;
-    get_reg8(reg) = get_reg8(reg) >> 1 | (bit_0 << 7);
+    u8 bit_0 = get_reg8<reg>() & 1;
+    get_reg8<reg>() = get_reg8<reg>() >> 1 | (bit_0 << 7);
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_0);
 }
@@ -881,10 +722,10 @@ void CPU::rrc_hli() {
 template<Reg8 reg>
 void CPU::rr() {
     m_clock.add_m(1);
-    u8 bit_0 = get_reg8(reg) & 1;
-    get_reg8(reg) = get_reg8(reg) >> 1 | (get_flag(CARRY) << 7);
+    u8 bit_0 = get_reg8<reg>() & 1;
+    get_reg8<reg>() = get_reg8<reg>() >> 1 | (get_flag(CARRY) << 7);
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_0);
 }
@@ -902,10 +743,10 @@ void CPU::rr_hli() {
 template<Reg8 reg>
 void CPU::sla() {
     m_clock.add_m(1);
-    u8 bit_7 = get_reg8(reg) >> 7;
-    get_reg8(reg) = get_reg8(reg) << 1 & 0xfe;
+    u8 bit_7 = get_reg8<reg>() >> 7;
+    get_reg8<reg>() = get_reg8<reg>() << 1 & 0xfe;
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_7);
 }
@@ -923,11 +764,11 @@ void CPU::sla_hli() {
 template<Reg8 reg>
 void CPU::sra() {
     m_clock.add_m(1);
-    u8 bit_7 = get_reg8(reg) >> 7;
-    u8 bit_0 = get_reg8(reg) & 1;
-    get_reg8(reg) = get_reg8(reg) >> 1 | (bit_7 << 7);
+    u8 bit_7 = get_reg8<reg>() >> 7;
+    u8 bit_0 = get_reg8<reg>() & 1;
+    get_reg8<reg>() = get_reg8<reg>() >> 1 | (bit_7 << 7);
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_0);
 }
@@ -946,10 +787,10 @@ void CPU::sra_hli() {
 template<Reg8 reg>
 void CPU::srl() {
     m_clock.add_m(1);
-    u8 bit_0 = get_reg8(reg) & 1;
-    get_reg8(reg) = get_reg8(reg) >> 1;
+    u8 bit_0 = get_reg8<reg>() & 1;
+    get_reg8<reg>() = get_reg8<reg>() >> 1;
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY);
     set_flags_if(CARRY, bit_0);
 }
@@ -967,9 +808,9 @@ void CPU::srl_hli() {
 template<Reg8 reg>
 void CPU::swap() {
     m_clock.add_m(1);
-    get_reg8(reg) = (get_reg8(reg) << 4) | (get_reg8(reg) >> 4);
+    get_reg8<reg>() = (get_reg8<reg>() << 4) | (get_reg8<reg>() >> 4);
 
-    set_flags_if(ZERO, get_reg8(reg) == 0);
+    set_flags_if(ZERO, get_reg8<reg>() == 0);
     reset_flags(SUBTRACTION | HALF_CARRY | CARRY);
 }
 
@@ -982,263 +823,269 @@ void CPU::swap_hli() {
 }
 
 
+//Every opcode's handler, so the table and the threaded dispatch are both built from the same list
+#define SB_OPCODES(X) \
+    X(0x00, nop) \
+    X(0x01, ld_rr_nn<BC>) \
+    X(0x02, ld_ri_a<BC>) \
+    X(0x03, inc_rr<BC>) \
+    X(0x04, inc_r<B>) \
+    X(0x05, dec_r<B>) \
+    X(0x06, ld_r_n<B>) \
+    X(0x07, rlca) \
+    X(0x08, ld_nn_sp) \
+    X(0x09, add_hl_rr<BC>) \
+    X(0x0A, ld_a_ri<BC>) \
+    X(0x0B, dec_rr<BC>) \
+    X(0x0C, inc_r<C>) \
+    X(0x0D, dec_r<C>) \
+    X(0x0E, ld_r_n<C>) \
+    X(0x0F, rrca) \
+    X(0x10, stop) \
+    X(0x11, ld_rr_nn<DE>) \
+    X(0x12, ld_ri_a<DE>) \
+    X(0x13, inc_rr<DE>) \
+    X(0x14, inc_r<D>) \
+    X(0x15, dec_r<D>) \
+    X(0x16, ld_r_n<D>) \
+    X(0x17, rla) \
+    X(0x18, rel_jp) \
+    X(0x19, add_hl_rr<DE>) \
+    X(0x1A, ld_a_ri<DE>) \
+    X(0x1B, dec_rr<DE>) \
+    X(0x1C, inc_r<E>) \
+    X(0x1D, dec_r<E>) \
+    X(0x1E, ld_r_n<E>) \
+    X(0x1F, rra) \
+    X(0x20, rel_jp_if_not<ZERO>) \
+    X(0x21, ld_rr_nn<HL>) \
+    X(0x22, ld_hli_a<1>) \
+    X(0x23, inc_rr<HL>) \
+    X(0x24, inc_r<H>) \
+    X(0x25, dec_r<H>) \
+    X(0x26, ld_r_n<H>) \
+    X(0x27, daa) \
+    X(0x28, rel_jp_if<ZERO>) \
+    X(0x29, add_hl_rr<HL>) \
+    X(0x2A, ld_a_hli<1>) \
+    X(0x2B, dec_rr<HL>) \
+    X(0x2C, inc_r<L>) \
+    X(0x2D, dec_r<L>) \
+    X(0x2E, ld_r_n<L>) \
+    X(0x2F, cpl) \
+    X(0x30, rel_jp_if_not<CARRY>) \
+    X(0x31, ld_rr_nn<SP>) \
+    X(0x32, ld_hli_a<-1>) \
+    X(0x33, inc_rr<SP>) \
+    X(0x34, inc_hli) \
+    X(0x35, dec_hli) \
+    X(0x36, ld_hl_n) \
+    X(0x37, scf) \
+    X(0x38, rel_jp_if<CARRY>) \
+    X(0x39, add_hl_rr<SP>) \
+    X(0x3A, ld_a_hli<-1>) \
+    X(0x3B, dec_rr<SP>) \
+    X(0x3C, inc_r<A>) \
+    X(0x3D, dec_r<A>) \
+    X(0x3E, ld_r_n<A>) \
+    X(0x3F, ccf) \
+    X(0x40, ld_r_r<B, B>) \
+    X(0x41, ld_r_r<B, C>) \
+    X(0x42, ld_r_r<B, D>) \
+    X(0x43, ld_r_r<B, E>) \
+    X(0x44, ld_r_r<B, H>) \
+    X(0x45, ld_r_r<B, L>) \
+    X(0x46, ld_r_hl<B>) \
+    X(0x47, ld_r_r<B, A>) \
+    X(0x48, ld_r_r<C, B>) \
+    X(0x49, ld_r_r<C, C>) \
+    X(0x4A, ld_r_r<C, D>) \
+    X(0x4B, ld_r_r<C, E>) \
+    X(0x4C, ld_r_r<C, H>) \
+    X(0x4D, ld_r_r<C, L>) \
+    X(0x4E, ld_r_hl<C>) \
+    X(0x4F, ld_r_r<C, A>) \
+    X(0x50, ld_r_r<D, B>) \
+    X(0x51, ld_r_r<D, C>) \
+    X(0x52, ld_r_r<D, D>) \
+    X(0x53, ld_r_r<D, E>) \
+    X(0x54, ld_r_r<D, H>) \
+    X(0x55, ld_r_r<D, L>) \
+    X(0x56, ld_r_hl<D>) \
+    X(0x57, ld_r_r<D, A>) \
+    X(0x58, ld_r_r<E, B>) \
+    X(0x59, ld_r_r<E, C>) \
+    X(0x5A, ld_r_r<E, D>) \
+    X(0x5B, ld_r_r<E, E>) \
+    X(0x5C, ld_r_r<E, H>) \
+    X(0x5D, ld_r_r<E, L>) \
+    X(0x5E, ld_r_hl<E>) \
+    X(0x5F, ld_r_r<E, A>) \
+    X(0x60, ld_r_r<H, B>) \
+    X(0x61, ld_r_r<H, C>) \
+    X(0x62, ld_r_r<H, D>) \
+    X(0x63, ld_r_r<H, E>) \
+    X(0x64, ld_r_r<H, H>) \
+    X(0x65, ld_r_r<H, L>) \
+    X(0x66, ld_r_hl<H>) \
+    X(0x67, ld_r_r<H, A>) \
+    X(0x68, ld_r_r<L, B>) \
+    X(0x69, ld_r_r<L, C>) \
+    X(0x6A, ld_r_r<L, D>) \
+    X(0x6B, ld_r_r<L, E>) \
+    X(0x6C, ld_r_r<L, H>) \
+    X(0x6D, ld_r_r<L, L>) \
+    X(0x6E, ld_r_hl<L>) \
+    X(0x6F, ld_r_r<L, A>) \
+    X(0x70, ld_hl_r<B>) \
+    X(0x71, ld_hl_r<C>) \
+    X(0x72, ld_hl_r<D>) \
+    X(0x73, ld_hl_r<E>) \
+    X(0x74, ld_hl_r<H>) \
+    X(0x75, ld_hl_r<L>) \
+    X(0x76, halt) \
+    X(0x77, ld_hl_r<A>) \
+    X(0x78, ld_r_r<A, B>) \
+    X(0x79, ld_r_r<A, C>) \
+    X(0x7A, ld_r_r<A, D>) \
+    X(0x7B, ld_r_r<A, E>) \
+    X(0x7C, ld_r_r<A, H>) \
+    X(0x7D, ld_r_r<A, L>) \
+    X(0x7E, ld_r_hl<A>) \
+    X(0x7F, ld_r_r<A, A>) \
+    X(0x80, alu_a_r<ADD, B>) \
+    X(0x81, alu_a_r<ADD, C>) \
+    X(0x82, alu_a_r<ADD, D>) \
+    X(0x83, alu_a_r<ADD, E>) \
+    X(0x84, alu_a_r<ADD, H>) \
+    X(0x85, alu_a_r<ADD, L>) \
+    X(0x86, alu_a_hli<ADD>) \
+    X(0x87, alu_a_r<ADD, A>) \
+    X(0x88, alu_a_r<ADC, B>) \
+    X(0x89, alu_a_r<ADC, C>) \
+    X(0x8A, alu_a_r<ADC, D>) \
+    X(0x8B, alu_a_r<ADC, E>) \
+    X(0x8C, alu_a_r<ADC, H>) \
+    X(0x8D, alu_a_r<ADC, L>) \
+    X(0x8E, alu_a_hli<ADC>) \
+    X(0x8F, alu_a_r<ADC, A>) \
+    X(0x90, alu_a_r<SUB, B>) \
+    X(0x91, alu_a_r<SUB, C>) \
+    X(0x92, alu_a_r<SUB, D>) \
+    X(0x93, alu_a_r<SUB, E>) \
+    X(0x94, alu_a_r<SUB, H>) \
+    X(0x95, alu_a_r<SUB, L>) \
+    X(0x96, alu_a_hli<SUB>) \
+    X(0x97, alu_a_r<SUB, A>) \
+    X(0x98, alu_a_r<SBC, B>) \
+    X(0x99, alu_a_r<SBC, C>) \
+    X(0x9A, alu_a_r<SBC, D>) \
+    X(0x9B, alu_a_r<SBC, E>) \
+    X(0x9C, alu_a_r<SBC, H>) \
+    X(0x9D, alu_a_r<SBC, L>) \
+    X(0x9E, alu_a_hli<SBC>) \
+    X(0x9F, alu_a_r<SBC, A>) \
+    X(0xA0, alu_a_r<AND, B>) \
+    X(0xA1, alu_a_r<AND, C>) \
+    X(0xA2, alu_a_r<AND, D>) \
+    X(0xA3, alu_a_r<AND, E>) \
+    X(0xA4, alu_a_r<AND, H>) \
+    X(0xA5, alu_a_r<AND, L>) \
+    X(0xA6, alu_a_hli<AND>) \
+    X(0xA7, alu_a_r<AND, A>) \
+    X(0xA8, alu_a_r<XOR, B>) \
+    X(0xA9, alu_a_r<XOR, C>) \
+    X(0xAA, alu_a_r<XOR, D>) \
+    X(0xAB, alu_a_r<XOR, E>) \
+    X(0xAC, alu_a_r<XOR, H>) \
+    X(0xAD, alu_a_r<XOR, L>) \
+    X(0xAE, alu_a_hli<XOR>) \
+    X(0xAF, alu_a_r<XOR, A>) \
+    X(0xB0, alu_a_r<OR, B>) \
+    X(0xB1, alu_a_r<OR, C>) \
+    X(0xB2, alu_a_r<OR, D>) \
+    X(0xB3, alu_a_r<OR, E>) \
+    X(0xB4, alu_a_r<OR, H>) \
+    X(0xB5, alu_a_r<OR, L>) \
+    X(0xB6, alu_a_hli<OR>) \
+    X(0xB7, alu_a_r<OR, A>) \
+    X(0xB8, alu_a_r<CP, B>) \
+    X(0xB9, alu_a_r<CP, C>) \
+    X(0xBA, alu_a_r<CP, D>) \
+    X(0xBB, alu_a_r<CP, E>) \
+    X(0xBC, alu_a_r<CP, H>) \
+    X(0xBD, alu_a_r<CP, L>) \
+    X(0xBE, alu_a_hli<CP>) \
+    X(0xBF, alu_a_r<CP, A>) \
+    X(0xC0, ret_if_not<ZERO>) \
+    X(0xC1, pop_r<BC>) \
+    X(0xC2, abs_jp_if_not<ZERO>) \
+    X(0xC3, abs_jp) \
+    X(0xC4, call_if_not<ZERO>) \
+    X(0xC5, push_r<BC>) \
+    X(0xC6, alu_a_n<ADD>) \
+    X(0xC7, rst<0x00>) \
+    X(0xC8, ret_if<ZERO>) \
+    X(0xC9, ret) \
+    X(0xCA, abs_jp_if<ZERO>) \
+    X(0xCB, prefix_cb) \
+    X(0xCC, call_if<ZERO>) \
+    X(0xCD, call) \
+    X(0xCE, alu_a_n<ADC>) \
+    X(0xCF, rst<0x08>) \
+    X(0xD0, ret_if_not<CARRY>) \
+    X(0xD1, pop_r<DE>) \
+    X(0xD2, abs_jp_if_not<CARRY>) \
+    X(0xD3, illegal) \
+    X(0xD4, call_if_not<CARRY>) \
+    X(0xD5, push_r<DE>) \
+    X(0xD6, alu_a_n<SUB>) \
+    X(0xD7, rst<0x10>) \
+    X(0xD8, ret_if<CARRY>) \
+    X(0xD9, reti) \
+    X(0xDA, abs_jp_if<CARRY>) \
+    X(0xDB, illegal) \
+    X(0xDC, call_if<CARRY>) \
+    X(0xDD, illegal) \
+    X(0xDE, alu_a_n<SBC>) \
+    X(0xDF, rst<0x18>) \
+    X(0xE0, write_io_n) \
+    X(0xE1, pop_r<HL>) \
+    X(0xE2, write_io_c) \
+    X(0xE3, illegal) \
+    X(0xE4, illegal) \
+    X(0xE5, push_r<HL>) \
+    X(0xE6, alu_a_n<AND>) \
+    X(0xE7, rst<0x20>) \
+    X(0xE8, add_sp_n) \
+    X(0xE9, abs_jp_hl) \
+    X(0xEA, ld_nn_a) \
+    X(0xEB, illegal) \
+    X(0xEC, illegal) \
+    X(0xED, illegal) \
+    X(0xEE, alu_a_n<XOR>) \
+    X(0xEF, rst<0x28>) \
+    X(0xF0, read_io_n) \
+    X(0xF1, pop_r<AF>) \
+    X(0xF2, read_io_c) \
+    X(0xF3, toggle_ints<false>) \
+    X(0xF4, illegal) \
+    X(0xF5, push_r<AF>) \
+    X(0xF6, alu_a_n<OR>) \
+    X(0xF7, rst<0x30>) \
+    X(0xF8, ld_hl_spn) \
+    X(0xF9, ld_sp_hl) \
+    X(0xFA, ld_a_nn) \
+    X(0xFB, toggle_ints<true>) \
+    X(0xFC, illegal) \
+    X(0xFD, illegal) \
+    X(0xFE, alu_a_n<CP>) \
+    X(0xFF, rst<0x38>)
+
+#define SB_OPCODE_POINTER(opcode, ...) &CPU::__VA_ARGS__,
+
 std::array<u8 (CPU::*)(u8 first, u8 second), 256> CPU::m_opcodes = {
-    &CPU::nop,     //0x00
-    &CPU::ld_rr_nn<BC>, //0x01
-    &CPU::ld_ri_a<BC>, //0x02
-    &CPU::inc_rr<BC>, //0x03
-    &CPU::inc_r<B>, //0x04
-    &CPU::dec_r<B>, //0x05
-    &CPU::ld_r_n<B>, //0x06
-    &CPU::rlca, //0x07
-    &CPU::ld_nn_sp, //0x08
-    &CPU::add_hl_rr<BC>, //0x09
-    &CPU::ld_a_ri<BC>, //0x0A
-    &CPU::dec_rr<BC>, //0x0B
-    &CPU::inc_r<C>, //0x0C
-    &CPU::dec_r<C>, //0x0D
-    &CPU::ld_r_n<C>, //0x0E
-    &CPU::rrca, //0x0F
-    &CPU::stop, //0x10
-    &CPU::ld_rr_nn<DE>, //0x11
-    &CPU::ld_ri_a<DE>, //0x12
-    &CPU::inc_rr<DE>, //0x13
-    &CPU::inc_r<D>, //0x14
-    &CPU::dec_r<D>, //0x15
-    &CPU::ld_r_n<D>, //0x16
-    &CPU::rla, //0x17
-    &CPU::rel_jp, //0x18
-    &CPU::add_hl_rr<DE>, //0x19
-    &CPU::ld_a_ri<DE>, //0x1A
-    &CPU::dec_rr<DE>, //0x1B
-    &CPU::inc_r<E>, //0x1C
-    &CPU::dec_r<E>, //0x1D
-    &CPU::ld_r_n<E>, //0x1E
-    &CPU::rra, //0x1F
-    &CPU::rel_jp_if_not<ZERO>, //0x20
-    &CPU::ld_rr_nn<HL>, //0x21
-    &CPU::ld_hli_a<1>, //0x22
-    &CPU::inc_rr<HL>, //0x23
-    &CPU::inc_r<H>, //0x24
-    &CPU::dec_r<H>, //0x25
-    &CPU::ld_r_n<H>, //0x26
-    &CPU::daa, //0x27
-    &CPU::rel_jp_if<ZERO>, //0x28
-    &CPU::add_hl_rr<HL>, //0x29
-    &CPU::ld_a_hli<1>, //0x2A
-    &CPU::dec_rr<HL>, //0x2B
-    &CPU::inc_r<L>, //0x2C
-    &CPU::dec_r<L>, //0x2D
-    &CPU::ld_r_n<L>, //0x2E
-    &CPU::cpl, //0x2F
-    &CPU::rel_jp_if_not<CARRY>, //0x30
-    &CPU::ld_rr_nn<SP>, //0x31
-    &CPU::ld_hli_a<-1>, //0x32
-    &CPU::inc_rr<SP>, //0x33
-    &CPU::inc_hli, //0x34
-    &CPU::dec_hli, //0x35
-    &CPU::ld_hl_n, //0x36
-    &CPU::scf, //0x37
-    &CPU::rel_jp_if<CARRY>, //0x38
-    &CPU::add_hl_rr<SP>, //0x39
-    &CPU::ld_a_hli<-1>, //0x3A
-    &CPU::dec_rr<SP>, //0x3B
-    &CPU::inc_r<A>, //0x3C
-    &CPU::dec_r<A>, //0x3D
-    &CPU::ld_r_n<A>, //0x3E
-    &CPU::ccf, //0x3F
-    &CPU::ld_r_r<B, B>, //0x40
-    &CPU::ld_r_r<B, C>, //0x41
-    &CPU::ld_r_r<B, D>, //0x42
-    &CPU::ld_r_r<B, E>, //0x43
-    &CPU::ld_r_r<B, H>, //0x44
-    &CPU::ld_r_r<B, L>, //0x45
-    &CPU::ld_r_hl<B>, //0x46
-    &CPU::ld_r_r<B, A>, //0x47
-    &CPU::ld_r_r<C, B>, //0x48
-    &CPU::ld_r_r<C, C>, //0x49
-    &CPU::ld_r_r<C, D>, //0x4A
-    &CPU::ld_r_r<C, E>, //0x4B
-    &CPU::ld_r_r<C, H>, //0x4C
-    &CPU::ld_r_r<C, L>, //0x4D
-    &CPU::ld_r_hl<C>, //0x4E
-    &CPU::ld_r_r<C, A>, //0x4F
-    &CPU::ld_r_r<D, B>, //0x50
-    &CPU::ld_r_r<D, C>, //0x51
-    &CPU::ld_r_r<D, D>, //0x52
-    &CPU::ld_r_r<D, E>, //0x53
-    &CPU::ld_r_r<D, H>, //0x54
-    &CPU::ld_r_r<D, L>, //0x55
-    &CPU::ld_r_hl<D>, //0x56
-    &CPU::ld_r_r<D, A>, //0x57
-    &CPU::ld_r_r<E, B>, //0x58
-    &CPU::ld_r_r<E, C>, //0x59
-    &CPU::ld_r_r<E, D>, //0x5A
-    &CPU::ld_r_r<E, E>, //0x5B
-    &CPU::ld_r_r<E, H>, //0x5C
-    &CPU::ld_r_r<E, L>, //0x5D
-    &CPU::ld_r_hl<E>, //0x5E
-    &CPU::ld_r_r<E, A>, //0x5F
-    &CPU::ld_r_r<H, B>, //0x60
-    &CPU::ld_r_r<H, C>, //0x61
-    &CPU::ld_r_r<H, D>, //0x62
-    &CPU::ld_r_r<H, E>, //0x63
-    &CPU::ld_r_r<H, H>, //0x64
-    &CPU::ld_r_r<H, L>, //0x65
-    &CPU::ld_r_hl<H>, //0x66
-    &CPU::ld_r_r<H, A>, //0x67
-    &CPU::ld_r_r<L, B>, //0x68
-    &CPU::ld_r_r<L, C>, //0x69
-    &CPU::ld_r_r<L, D>, //0x6A
-    &CPU::ld_r_r<L, E>, //0x6B
-    &CPU::ld_r_r<L, H>, //0x6C
-    &CPU::ld_r_r<L, L>, //0x6D
-    &CPU::ld_r_hl<L>, //0x6E
-    &CPU::ld_r_r<L, A>, //0x6F
-    &CPU::ld_hl_r<B>, //0x70
-    &CPU::ld_hl_r<C>, //0x71
-    &CPU::ld_hl_r<D>, //0x72
-    &CPU::ld_hl_r<E>, //0x73
-    &CPU::ld_hl_r<H>, //0x74
-    &CPU::ld_hl_r<L>, //0x75
-    &CPU::halt, //0x76
-    &CPU::ld_hl_r<A>, //0x77
-    &CPU::ld_r_r<A, B>, //0x78
-    &CPU::ld_r_r<A, C>, //0x79
-    &CPU::ld_r_r<A, D>, //0x7A
-    &CPU::ld_r_r<A, E>, //0x7B
-    &CPU::ld_r_r<A, H>, //0x7C
-    &CPU::ld_r_r<A, L>, //0x7D
-    &CPU::ld_r_hl<A>, //0x7E
-    &CPU::ld_r_r<A, A>, //0x7F
-    &CPU::alu_a_r<ADD, B>, //0x80
-    &CPU::alu_a_r<ADD, C>, //0x81
-    &CPU::alu_a_r<ADD, D>, //0x82
-    &CPU::alu_a_r<ADD, E>, //0x83
-    &CPU::alu_a_r<ADD, H>, //0x84
-    &CPU::alu_a_r<ADD, L>, //0x85
-    &CPU::alu_a_hli<ADD>, //0x86
-    &CPU::alu_a_r<ADD, A>, //0x87
-    &CPU::alu_a_r<ADC, B>, //0x88
-    &CPU::alu_a_r<ADC, C>, //0x89
-    &CPU::alu_a_r<ADC, D>, //0x8A
-    &CPU::alu_a_r<ADC, E>, //0x8B
-    &CPU::alu_a_r<ADC, H>, //0x8C
-    &CPU::alu_a_r<ADC, L>, //0x8D
-    &CPU::alu_a_hli<ADC>, //0x8E
-    &CPU::alu_a_r<ADC, A>, //0x8F
-    &CPU::alu_a_r<SUB, B>, //0x90
-    &CPU::alu_a_r<SUB, C>, //0x91
-    &CPU::alu_a_r<SUB, D>, //0x92
-    &CPU::alu_a_r<SUB, E>, //0x93
-    &CPU::alu_a_r<SUB, H>, //0x94
-    &CPU::alu_a_r<SUB, L>, //0x95
-    &CPU::alu_a_hli<SUB>, //0x96
-    &CPU::alu_a_r<SUB, A>, //0x97
-    &CPU::alu_a_r<SBC, B>, //0x98
-    &CPU::alu_a_r<SBC, C>, //0x99
-    &CPU::alu_a_r<SBC, D>, //0x9A
-    &CPU::alu_a_r<SBC, E>, //0x9B
-    &CPU::alu_a_r<SBC, H>, //0x9C
-    &CPU::alu_a_r<SBC, L>, //0x9D
-    &CPU::alu_a_hli<SBC>, //0x9E
-    &CPU::alu_a_r<SBC, A>, //0x9F
-    &CPU::alu_a_r<AND, B>, //0xA0
-    &CPU::alu_a_r<AND, C>, //0xA1
-    &CPU::alu_a_r<AND, D>, //0xA2
-    &CPU::alu_a_r<AND, E>, //0xA3
-    &CPU::alu_a_r<AND, H>, //0xA4
-    &CPU::alu_a_r<AND, L>, //0xA5
-    &CPU::alu_a_hli<AND>, //0xA6
-    &CPU::alu_a_r<AND, A>, //0xA7
-    &CPU::alu_a_r<XOR, B>, //0xA8
-    &CPU::alu_a_r<XOR, C>, //0xA9
-    &CPU::alu_a_r<XOR, D>, //0xAA
-    &CPU::alu_a_r<XOR, E>, //0xAB
-    &CPU::alu_a_r<XOR, H>, //0xAC
-    &CPU::alu_a_r<XOR, L>, //0xAD
-    &CPU::alu_a_hli<XOR>, //0xAE
-    &CPU::alu_a_r<XOR, A>, //0xAF
-    &CPU::alu_a_r<OR, B>, //0xB0
-    &CPU::alu_a_r<OR, C>, //0xB1
-    &CPU::alu_a_r<OR, D>, //0xB2
-    &CPU::alu_a_r<OR, E>, //0xB3
-    &CPU::alu_a_r<OR, H>, //0xB4
-    &CPU::alu_a_r<OR, L>, //0xB5
-    &CPU::alu_a_hli<OR>, //0xB6
-    &CPU::alu_a_r<OR, A>, //0xB7
-    &CPU::alu_a_r<CP, B>, //0xB8
-    &CPU::alu_a_r<CP, C>, //0xB9
-    &CPU::alu_a_r<CP, D>, //0xBA
-    &CPU::alu_a_r<CP, E>, //0xBB
-    &CPU::alu_a_r<CP, H>, //0xBC
-    &CPU::alu_a_r<CP, L>, //0xBD
-    &CPU::alu_a_hli<CP>, //0xBE
-    &CPU::alu_a_r<CP, A>, //0xBF
-    &CPU::ret_if_not<ZERO>, //0xC0
-    &CPU::pop_r<BC>, //0xC1
-    &CPU::abs_jp_if_not<ZERO>, //0xC2
-    &CPU::abs_jp, //0xC3
-    &CPU::call_if_not<ZERO>, //0xC4
-    &CPU::push_r<BC>, //0xC5
-    &CPU::alu_a_n<ADD>, //0xC6
-    &CPU::rst<0x00>, //0xC7
-    &CPU::ret_if<ZERO>, //0xC8
-    &CPU::ret, //0xC9
-    &CPU::abs_jp_if<ZERO>, //0xCA
-    &CPU::prefix_cb, //0xCB
-    &CPU::call_if<ZERO>, //0xCC
-    &CPU::call, //0xCD
-    &CPU::alu_a_n<ADC>, //0xCE
-    &CPU::rst<0x08>, //0xCF
-    &CPU::ret_if_not<CARRY>, //0xD0
-    &CPU::pop_r<DE>, //0xD1
-    &CPU::abs_jp_if_not<CARRY>, //0xD2
-    &CPU::illegal, //0xD3
-    &CPU::call_if_not<CARRY>, //0xD4
-    &CPU::push_r<DE>, //0xD5
-    &CPU::alu_a_n<SUB>, //0xD6
-    &CPU::rst<0x10>, //0xD7
-    &CPU::ret_if<CARRY>, //0xD8
-    &CPU::reti, //0xD9
-    &CPU::abs_jp_if<CARRY>, //0xDA
-    &CPU::illegal, //0xDB
-    &CPU::call_if<CARRY>, //0xDC
-    &CPU::illegal, //0xDD
-    &CPU::alu_a_n<SBC>, //0xDE
-    &CPU::rst<0x18>, //0xDF
-    &CPU::write_io_n, //0xE0
-    &CPU::pop_r<HL>, //0xE1
-    &CPU::write_io_c, //0xE2
-    &CPU::illegal, //0xE3
-    &CPU::illegal, //0xE4
-    &CPU::push_r<HL>, //0xE5
-    &CPU::alu_a_n<AND>, //0xE6
-    &CPU::rst<0x20>, //0xE7
-    &CPU::add_sp_n, //0xE8
-    &CPU::abs_jp_hl, //0xE9
-    &CPU::ld_nn_a, //0xEA
-    &CPU::illegal, //0xEB
-    &CPU::illegal, //0xEC
-    &CPU::illegal, //0xED
-    &CPU::alu_a_n<XOR>, //0xEE
-    &CPU::rst<0x28>, //0xEF
-    &CPU::read_io_n, //0xF0
-    &CPU::pop_r<AF>, //0xF1
-    &CPU::read_io_c, //0xF2
-    &CPU::toggle_ints<false>, //0xF3
-    &CPU::illegal, //0xF4
-    &CPU::push_r<AF>, //0xF5
-    &CPU::alu_a_n<OR>, //0xF6
-    &CPU::rst<0x30>, //0xF7
-    &CPU::ld_hl_spn, //0xF8
-    &CPU::ld_sp_hl, //0xF9
-    &CPU::ld_a_nn, //0xFA
-    &CPU::toggle_ints<true>, //0xFB
-    &CPU::illegal, //0xFC
-    &CPU::illegal, //0xFD
-    &CPU::alu_a_n<CP>, //0xFE
-    &CPU::rst<0x38>, //0xFF
+    SB_OPCODES(SB_OPCODE_POINTER)
 };
 
 std::array<void (CPU::*)(), 256> CPU::m_cb_opcodes = {
@@ -1500,4 +1347,34 @@ std::array<void (CPU::*)(), 256> CPU::m_cb_opcodes = {
     &CPU::set_n_r<7, A>, //0xFF
 };
 
+#if defined(SB_THREADED_DISPATCH)
+
+#define SB_HANDLER_ADDRESS(number, ...) &&op_##number,
+#define SB_THREADED_HANDLER(number, ...) \
+    op_##number: \
+        pc.value += 1 + __VA_ARGS__(instruction->first, instruction->second); \
+        \
+        if((instruction = next_instruction(scheduler)) == nullptr) { \
+            return; \
+        } \
+        \
+        goto *handlers[instruction->opcode];
+
+//Same as the table version in CPU.cpp, except every handler gets called directly and has its own jump to the next one.
+//Each of those jumps gets its own history in the branch predictor, instead of every opcode sharing one indirect call.
+void CPU::run(Scheduler &scheduler) {
+    static void *const handlers[256] = { SB_OPCODES(SB_HANDLER_ADDRESS) };
+    const DecodedInstruction *instruction = prepare(scheduler);
+
+    if(instruction == nullptr && (instruction = next_instruction(scheduler)) == nullptr) {
+        return;
+    }
+
+    goto *handlers[instruction->opcode];
+
+    SB_OPCODES(SB_THREADED_HANDLER)
+}
+
+#endif
+
 } //namespace sb
\ No newline at end of file
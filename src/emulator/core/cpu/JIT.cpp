@@ -0,0 +1,319 @@
+#include "JIT.hpp"
+#include "CPU.hpp"
+
+#include <cstring>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+
+namespace sb {
+
+constexpr usize CODE_SIZE = 4 * 1024 * KiB;
+
+//Register order used in the opcode bits, index 6 is (HL) which never gets here
+static const Reg8 opcode_reg8[8] = {B, C, D, E, H, L, F, A};
+static const Reg16 opcode_reg16[4] = {BC, DE, HL, SP};
+
+//x86 scratch registers
+enum X86Reg : u8 {
+    EAX, ECX, EDX
+};
+
+//Only instructions that work purely on registers and can't jump, halt, or change IME
+bool is_native(u8 opcode, u8 first) {
+    u8 x = opcode >> 6;
+    u8 y = opcode >> 3 & 7;
+    u8 z = opcode & 7;
+
+    switch(x) {
+        case 0 :
+            switch(z) {
+                case 0 : return opcode == 0x00; //nop, the rest are jumps, stop, and ld (nn), sp
+                case 1 : return true;  //ld rr, nn and add hl, rr
+                case 2 : return false; //Indirect loads
+                case 3 : return true;  //inc rr and dec rr
+                case 7 : return true;  //Rotates on A, daa, cpl, scf, and ccf
+                default : return y != 6; //inc r, dec r, and ld r, n
+            }
+        case 1 : return y != 6 && z != 6;
+        case 2 : return z != 6;
+        default :
+            if(opcode == 0xCB) {
+                return (first & 7) != 6;
+            }
+
+            return z == 6 || opcode == 0xE8 || opcode == 0xF8 || opcode == 0xF9;
+    }
+}
+
+//The code buffer is never writable and executable at once, some systems (SELinux with deny_execmem, PaX) refuse that.
+//It starts out executable and the pages being written to are flipped over for as long as that takes. If the system won't
+//allow even that, m_code is left null and the CPU sticks with the interpreter.
+JIT::JIT(const RegisterLayout &layout, NativeFallback fallback) : m_used(0), m_full(false), m_layout(layout), m_fallback(fallback) {
+    #if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    m_page_size = info.dwPageSize;
+    m_code = (u8*)VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    #else
+    m_page_size = sysconf(_SC_PAGESIZE);
+    m_code = (u8*)mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(m_code == MAP_FAILED) m_code = nullptr;
+    #endif
+
+    if(m_code != nullptr && !protect(0, CODE_SIZE, false)) {
+        #if defined(_WIN32)
+        VirtualFree(m_code, 0, MEM_RELEASE);
+        #else
+        munmap(m_code, CODE_SIZE);
+        #endif
+        m_code = nullptr;
+    }
+
+    //ZF, AF, and CF end up where Z, H, and C go
+    for(usize i = 0; i < 256; i++) {
+        m_flag_table[i] = (i & 0x40 ? ZERO : 0) | (i & 0x10 ? HALF_CARRY : 0) | (i & 0x01 ? CARRY : 0);
+    }
+}
+
+JIT::~JIT() {
+    if(m_code == nullptr) {
+        return;
+    }
+
+    #if defined(_WIN32)
+    VirtualFree(m_code, 0, MEM_RELEASE);
+    #else
+    munmap(m_code, CODE_SIZE);
+    #endif
+}
+
+bool JIT::supported() {
+    #if defined(SB_ARCH_X64)
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+//Makes every page the range touches either writable or executable
+bool JIT::protect(usize offset, usize size, bool writable) {
+    usize start = offset & ~(m_page_size - 1);
+    usize end = (offset + size + m_page_size - 1) & ~(m_page_size - 1);
+
+    #if defined(_WIN32)
+    DWORD old;
+    return VirtualProtect(m_code + start, end - start, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old) != 0;
+    #else
+    return mprotect(m_code + start, end - start, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+    #endif
+}
+
+void JIT::emit(std::initializer_list<u8> bytes) {
+    m_buffer.insert(m_buffer.end(), bytes);
+}
+
+void JIT::emit32(u32 value) {
+    for(usize i = 0; i < 4; i++) {
+        m_buffer.push_back(value >> (i * 8));
+    }
+}
+
+void JIT::emit64(u64 value) {
+    for(usize i = 0; i < 8; i++) {
+        m_buffer.push_back(value >> (i * 8));
+    }
+}
+
+//Any instruction with a [rbx + disp32] operand, rbx always holds the CPU
+void JIT::emit_rbx(u8 opcode, u8 reg, s32 offset) {
+    m_buffer.push_back(opcode);
+    m_buffer.push_back(0x80 | reg << 3 | 3);
+    emit32(offset);
+}
+
+//Expects the x86 flags in cl, F = (F & keep) | (flags & from_result) | set
+void JIT::emit_flags(u8 from_result, u8 keep, u8 set) {
+    s32 f = m_layout.reg8[F];
+
+    emit({0x0F, 0xB6, 0xC9}); //movzx ecx, cl
+    emit({0x49, 0xBB}); emit64((u64)m_flag_table); //mov r11, m_flag_table
+    emit({0x41, 0x0F, 0xB6, 0x14, 0x0B}); //movzx edx, byte [r11 + rcx]
+    emit({0x81, 0xE2}); emit32(from_result); //and edx, from_result
+    emit({0x0F}); emit_rbx(0xB6, ECX, f); //movzx ecx, byte [F]
+    emit({0x81, 0xE1}); emit32(keep); //and ecx, keep
+    emit({0x09, 0xCA}); //or edx, ecx
+    if(set != 0) { emit({0x81, 0xCA}); emit32(set); } //or edx, set
+    emit_rbx(0x88, EDX, f); //mov [F], dl
+}
+
+//Gives back false if the instruction has to go through the interpreter's handler instead
+bool JIT::emit_instruction(const DecodedInstruction &instruction) {
+    static const u8 alu_opcodes[8] = {0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38}; //add, adc, sub, sbb, and, xor, or, cmp
+    u8 opcode = instruction.opcode;
+    u8 x = opcode >> 6;
+    u8 y = opcode >> 3 & 7;
+    u8 z = opcode & 7;
+
+    if(opcode == 0x00) {
+        //nop
+    } else if(x == 1) {
+        //ld r, r
+        emit({0x0F}); emit_rbx(0xB6, EAX, m_layout.reg8[opcode_reg8[z]]); //movzx eax, byte [src]
+        emit_rbx(0x88, EAX, m_layout.reg8[opcode_reg8[y]]); //mov [dest], al
+    } else if(x == 0 && z == 6) {
+        //ld r, n
+        emit_rbx(0xC6, 0, m_layout.reg8[opcode_reg8[y]]); //mov byte [dest], n
+        emit({instruction.first});
+    } else if(x == 0 && z == 1 && (y & 1) == 0) {
+        //ld rr, nn
+        emit({0x66}); emit_rbx(0xC7, 0, m_layout.reg16[opcode_reg16[y >> 1]]); //mov word [dest], nn
+        emit({instruction.first, instruction.second});
+    } else if(x == 0 && z == 3) {
+        //inc rr and dec rr
+        emit({0x66}); emit_rbx(0xFF, y & 1, m_layout.reg16[opcode_reg16[y >> 1]]); //inc/dec word [reg]
+    } else if(x == 0 && (z == 4 || z == 5)) {
+        //inc r and dec r, C is left alone just like on x86
+        s32 reg = m_layout.reg8[opcode_reg8[y]];
+        emit({0x0F}); emit_rbx(0xB6, EAX, reg); //movzx eax, byte [reg]
+        emit({0xFE, (u8)(z == 4 ? 0xC0 : 0xC8)}); //inc/dec al
+        emit({0x9C, 0x59}); //pushfq, pop rcx
+        emit_rbx(0x88, EAX, reg); //mov [reg], al
+        emit_flags(ZERO | HALF_CARRY, CARRY | 0x0F, z == 4 ? 0 : SUBTRACTION);
+    } else if(x == 2 || (x == 3 && z == 6)) {
+        //ALU ops on A, x86 computes the same half carry and carry
+        s32 a = m_layout.reg8[A];
+        emit({0x0F}); emit_rbx(0xB6, EAX, a); //movzx eax, byte [A]
+
+        if(x == 2) {
+            emit({0x0F}); emit_rbx(0xB6, ECX, m_layout.reg8[opcode_reg8[z]]); //movzx ecx, byte [reg]
+        } else {
+            emit({0xB1, instruction.first}); //mov cl, n
+        }
+
+        if(y == ADC || y == SBC) {
+            emit({0x0F}); emit_rbx(0xB6, EDX, m_layout.reg8[F]); //movzx edx, byte [F]
+            emit({0x0F, 0xBA, 0xE2, 0x04}); //bt edx, 4
+        }
+
+        emit({alu_opcodes[y], 0xC8}); //op al, cl
+        emit({0x9C, 0x59}); //pushfq, pop rcx
+        if(y != CP) emit_rbx(0x88, EAX, a); //mov [A], al
+
+        switch(y) {
+            case ADD : case ADC : emit_flags(ZERO | HALF_CARRY | CARRY, 0x0F, 0);
+            break;
+            case SUB : case SBC : case CP : emit_flags(ZERO | HALF_CARRY | CARRY, 0x0F, SUBTRACTION);
+            break;
+            case AND : emit_flags(ZERO, 0x0F, HALF_CARRY);
+            break;
+            default : emit_flags(ZERO, 0x0F, 0);
+            break;
+        }
+    } else if(opcode == 0x2F) {
+        //cpl
+        emit_rbx(0xF6, 2, m_layout.reg8[A]); //not byte [A]
+        emit_rbx(0x80, 1, m_layout.reg8[F]); emit({SUBTRACTION | HALF_CARRY}); //or byte [F], N | H
+    } else if(opcode == 0x37 || opcode == 0x3F) {
+        //scf and ccf
+        emit_rbx(0x80, opcode == 0x37 ? 1 : 6, m_layout.reg8[F]); emit({CARRY}); //or/xor byte [F], C
+        emit_rbx(0x80, 4, m_layout.reg8[F]); emit({(u8)~(SUBTRACTION | HALF_CARRY)}); //and byte [F], ~(N | H)
+    } else if(opcode == 0xF9) {
+        //ld sp, hl
+        emit({0x0F}); emit_rbx(0xB7, EAX, m_layout.reg16[HL]); //movzx eax, word [HL]
+        emit({0x66}); emit_rbx(0x89, EAX, m_layout.reg16[SP]); //mov word [SP], ax
+    } else {
+        emit_fallback(instruction);
+        return false;
+    }
+
+    return true;
+}
+
+//Calls the interpreter's handler for the opcode through the CPU's fallback
+void JIT::emit_fallback(const DecodedInstruction &instruction) {
+    #if defined(_WIN32)
+    emit({0x48, 0x89, 0xD9}); //mov rcx, rbx
+    emit({0xBA}); emit32(instruction.opcode); //mov edx, opcode
+    emit({0x41, 0xB8}); emit32(instruction.first); //mov r8d, first
+    emit({0x41, 0xB9}); emit32(instruction.second); //mov r9d, second
+    #else
+    emit({0x48, 0x89, 0xDF}); //mov rdi, rbx
+    emit({0xBE}); emit32(instruction.opcode); //mov esi, opcode
+    emit({0xBA}); emit32(instruction.first); //mov edx, first
+    emit({0xB9}); emit32(instruction.second); //mov ecx, second
+    #endif
+
+    emit({0x48, 0xB8}); emit64((u64)m_fallback); //mov rax, m_fallback
+    emit({0xFF, 0xD0}); //call rax
+}
+
+//Gives back nullptr once the code buffer is full
+const NativeRun* JIT::compile(const DecodedInstruction *instructions, u8 length, const u8 *handler_cycles) {
+    m_buffer.clear();
+    u32 cycles = 0;
+    u32 clock_cycles = 0;
+
+    //Prologue, the CPU stays in rbx and the stack is kept aligned with shadow space for calls
+    emit({0x53}); //push rbx
+    #if defined(_WIN32)
+    emit({0x48, 0x89, 0xCB}); //mov rbx, rcx
+    #else
+    emit({0x48, 0x89, 0xFB}); //mov rbx, rdi
+    #endif
+    emit({0x48, 0x83, 0xEC, 0x20}); //sub rsp, 32
+
+    for(usize i = 0; i < length; i++) {
+        bool inlined = emit_instruction(instructions[i]);
+
+        //Fetching is never part of the handler
+        cycles += 1 + handler_cycles[i];
+        clock_cycles += 1 + (inlined ? handler_cycles[i] : 0);
+    }
+
+    emit({0x48, 0x83, 0xC4, 0x20}); //add rsp, 32
+    emit({0x5B}); //pop rbx
+    emit({0xC3}); //ret
+
+    if(m_used + m_buffer.size() > CODE_SIZE) {
+        if(!m_full) LOG_WARN("[JIT] : Out of code space, everything else stays in the interpreter");
+        m_full = true;
+
+        return nullptr;
+    }
+
+    u8 *code = m_code + m_used;
+
+    if(!protect(m_used, m_buffer.size(), true)) {
+        LOG_WARN("[JIT] : Couldn't write to the code buffer, everything else stays in the interpreter");
+        m_full = true;
+
+        return nullptr;
+    }
+
+    std::memcpy(code, m_buffer.data(), m_buffer.size());
+
+    if(!protect(m_used, m_buffer.size(), false)) {
+        LOG_FATAL("[JIT] : Couldn't make the code buffer executable again!"); //Earlier code shares these pages
+    }
+
+    m_used = (m_used + m_buffer.size() + 15) & ~15;
+
+    const DecodedInstruction &last = instructions[length - 1];
+    m_runs.push_back({reinterpret_cast<NativeFunction>(code), (u16)(last.address + last.length), length, (u8)cycles, (u8)clock_cycles});
+
+    return &m_runs.back();
+}
+
+void JIT::clear() {
+    m_used = 0;
+    m_full = false;
+    m_runs.clear();
+}
+
+} //namespace sb
\ No newline at end of file
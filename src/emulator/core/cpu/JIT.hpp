@@ -0,0 +1,76 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "common/Types.hpp"
+#include "common/Defines.hpp"
+#include "BlockCache.hpp"
+
+#include <deque>
+#include <vector>
+
+
+namespace sb {
+
+using NativeFunction = void (*)(CPU *cpu);
+using NativeFallback = void (*)(CPU *cpu, u32 opcode, u32 first, u32 second);
+
+//A run of instructions that only touch registers, compiled to native code
+struct NativeRun {
+    NativeFunction code;
+    u16 end;         //Address right after the last instruction
+    u8 length;       //Number of instructions
+    u8 cycles;       //M-cycles the whole run takes
+    u8 clock_cycles; //M-cycles the native code doesn't add to the clock itself
+};
+
+//Where the registers are inside the CPU, so native code can work on them in place
+struct RegisterLayout {
+    s32 reg8[8];  //Indexed by Reg8
+    s32 reg16[6]; //Indexed by Reg16
+};
+
+bool is_native(u8 opcode, u8 first);
+
+//Translates runs of register-only SM83 instructions into x86-64. Anything that touches memory, the pc, or the interrupt
+//state stays with the interpreter, since the rest of the system has to be caught up before it can be seen. Register-only
+//instructions that aren't worth emitting by hand call back into the interpreter's handlers.
+class JIT {
+private:
+
+    u8 *m_code;
+    usize m_page_size;
+    usize m_used;
+    bool m_full;
+    std::vector<u8> m_buffer; //The function being emitted
+    std::deque<NativeRun> m_runs;
+
+    RegisterLayout m_layout;
+    NativeFallback m_fallback;
+    u8 m_flag_table[256]; //x86 flags to SM83 flags
+
+    void emit(std::initializer_list<u8> bytes);
+    void emit32(u32 value);
+    void emit64(u64 value);
+    void emit_rbx(u8 opcode, u8 reg, s32 offset);
+    void emit_flags(u8 from_result, u8 keep, u8 set);
+    bool protect(usize offset, usize size, bool writable);
+
+    bool emit_instruction(const DecodedInstruction &instruction);
+    void emit_fallback(const DecodedInstruction &instruction);
+
+public:
+
+    JIT(const RegisterLayout &layout, NativeFallback fallback);
+    ~JIT();
+
+    static bool supported();
+    bool allocated() { return m_code != nullptr; }
+
+    const NativeRun* compile(const DecodedInstruction *instructions, u8 length, const u8 *handler_cycles);
+    void clear();
+};
+
+} //namespace sb
+
+
+#endif //JIT_HPP
\ No newline at end of file
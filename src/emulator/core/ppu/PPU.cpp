@@ -1,24 +1,24 @@
 #include "emulator/core/ppu/PPU.hpp"
+#include "emulator/core/ppu/TileDecode.hpp"
 #include "common/Utility.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 
 namespace sb {
 
-static const u32 shades[4] = {0xffffffff, 0xb3b3b3ff, 0x6b6b6bff, 0x000000ff};
-
-
-Fetcher::Fetcher(PPU &ppu) : m_ppu(ppu) { }
+Fetcher::Fetcher(PPU &ppu) : m_ticks(0), m_ppu(ppu) {
+    m_last_timing.ticks = 0xFF; //Nothing has been timed yet
+}
 
 Pixel Fetcher::fifo_pop() {
-    Pixel pixel = m_bg_fifo.front();
-    m_bg_fifo.pop_front();
+    Pixel pixel = m_bg_fifo.pop();
 
     //If there is pixels in the sprite fifo, then mix them
     if(!m_sprite_fifo.empty()) {
-        Pixel sprite_pixel = m_sprite_fifo.front();
-        m_sprite_fifo.pop_front();
+        Pixel sprite_pixel = m_sprite_fifo.pop();
+        sprite_pixel.palette++; //OBP0 is 1 and OBP1 is 2
 
         //Priority, only show sprite if background pixel is not color 0
         if(sprite_pixel.priority && pixel.color_index != 0) {
@@ -46,7 +46,7 @@ bool Fetcher::disabled() {
     return m_fetch_sprites;
 }
 
-void Fetcher::start(std::vector<ObjectData> sprites) {
+void Fetcher::start(const LineSprites &sprites) {
     u8 y = m_ppu.m_scy + m_ppu.m_ly;
     m_line_x = 0;
     m_tile_index = (m_ppu.m_scx / 8) & 0x1f;
@@ -59,11 +59,18 @@ void Fetcher::start(std::vector<ObjectData> sprites) {
     m_fetch_window = false;
     m_wy_triggered = m_ppu.m_ly >= m_ppu.m_wy;
     m_state = READ_TILE_ID;
+    m_line_ticks = m_ticks;
 
     m_bg_fifo.clear();
     m_sprite_fifo.clear();
 }
 
+//Goes back to the start of the line, the only thing left over from the line before is where it was in a fetch
+void Fetcher::restart(const LineSprites &sprites) {
+    m_ticks = m_line_ticks;
+    start(sprites);
+}
+
 void Fetcher::step() {
     m_ticks++;
     m_tile_address = (m_ppu.m_lcdc >> 4) & 1 ? 0x8000 : 0x9000; //0x9000 uses signed addressing so it can address [0x8800, 0x97FF].
@@ -77,14 +84,14 @@ void Fetcher::step() {
             //Clear fifo and set stuff for window
             u8 y = m_ppu.m_ly - m_ppu.m_wy;
             m_map_address = (m_ppu.m_lcdc >> 6) & 1 ? 0x9C00 : 0x9800;
-            m_map_address += (m_window_y / 8) * 32;
+            m_map_address += (m_ppu.m_window_line / 8) * 32;
             m_tile_index = 0;
-            m_tile_line = m_window_y % 8;
+            m_tile_line = m_ppu.m_window_line % 8;
             m_fetch_window = true;
             m_state = READ_TILE_ID;
 
             m_bg_fifo.clear();
-            m_window_y++;
+            m_ppu.m_window_line++;
         }
     }
 
@@ -112,6 +119,39 @@ void Fetcher::step() {
     check_for_obj();
 }
 
+//Runs the whole line without putting out any pixels and returns how many dots it took, the same as pixel_transfer would
+u16 Fetcher::run_line(const LineSprites &sprites) {
+    LineTiming timing = {m_ticks, (u8)(m_ppu.m_scx & 7), (u8)(m_ppu.m_lcdc & 0x22), m_ppu.m_wx, m_ppu.m_ly >= m_ppu.m_wy, sprites.count, {}};
+
+    for(u8 i = 0; i < sprites.count; i++) {
+        timing.sprite_x[i] = sprites.sprites[i].x;
+    }
+
+    if(timing == m_last_timing) {
+        m_line_ticks = m_ticks;
+        m_ticks = m_last_end_ticks;
+        return m_last_dots;
+    }
+
+    u16 dots = 0;
+    start(sprites);
+
+    for(u8 x = 0; x < GB_SCREEN_WIDTH; dots++) {
+        step();
+
+        if(fifo_size() > 8 && !disabled()) {
+            fifo_pop();
+            x++;
+        }
+    }
+
+    m_last_timing = timing;
+    m_last_end_ticks = m_ticks;
+    m_last_dots = dots;
+
+    return dots;
+}
+
 void Fetcher::check_for_obj() {
     //Check for sprites at this x
     bool obj_enable = (m_ppu.m_lcdc >> 1) & 1;
@@ -136,7 +176,7 @@ void Fetcher::check_for_obj() {
 }
 
 void Fetcher::read_tile_id() {
-    m_tile_id = m_ppu.read(m_map_address + m_tile_index);
+    m_tile_id = m_ppu.vram(m_map_address + m_tile_index);
     m_state = READ_TILE_0;
 }
 
@@ -145,22 +185,14 @@ void Fetcher::read_tile_0() {
         //Background stuff
         u16 offset = m_tile_address + (m_signed_addressing ? (s8)m_tile_id * 16 : m_tile_id * 16);
         u16 address = offset + m_tile_line * 2;
-        u8 data = m_ppu.read(address);
-
-        for(int i = 0; i < 8; i++) {
-            m_pixel_data[i] = (data >> i) & 1;
-        }
+        m_data_low = m_ppu.vram(address);
     } else {
         //Ignore first bit of tile id if it is double height
         u8 sprite_tile_id = (m_ppu.m_lcdc >> 2) & 1 ? m_current_sprite.tile_id & ~1 : m_current_sprite.tile_id;
 
         u16 offset = 0x8000 + sprite_tile_id * 16;
         u16 address = offset + m_sprite_line * 2;
-        u8 data = m_ppu.read(address);
-
-        for(int i = 0; i < 8; i++) {
-            m_pixel_data[i] = (data >> i) & 1;
-        }
+        m_data_low = m_ppu.vram(address);
     }
 
     m_state = READ_TILE_1;
@@ -171,22 +203,14 @@ void Fetcher::read_tile_1() {
         //Background stuff
         u16 offset = m_tile_address + (m_signed_addressing ? (s8)m_tile_id * 16 : m_tile_id * 16);
         u16 address = offset + m_tile_line * 2;
-        u8 data = m_ppu.read(address + 1);
-
-        for(int i = 0; i < 8; i++) {
-            m_pixel_data[i] |= ((data >> i) & 1) << 1;
-        }
+        m_data_high = m_ppu.vram(address + 1);
     } else {
         //Ignore first bit of tile id if it is double height
         u8 sprite_tile_id = (m_ppu.m_lcdc >> 2) & 1 ? m_current_sprite.tile_id & ~1 : m_current_sprite.tile_id;
 
         u16 offset = 0x8000 + sprite_tile_id * 16;
         u16 address = offset + m_sprite_line * 2;
-        u8 data = m_ppu.read(address + 1);
-
-        for(int i = 0; i < 8; i++) {
-            m_pixel_data[i] |= ((data >> i) & 1) << 1;
-        }
+        m_data_high = m_ppu.vram(address + 1);
     }
 
     m_state = PUSH_TO_FIFO;
@@ -194,40 +218,33 @@ void Fetcher::read_tile_1() {
 
 void Fetcher::push_to_fifo() {
     if(m_fetch_sprites) {
-        //Push pixels in if not 8 pixels wide
-        while(m_sprite_fifo.size() < 8) {
-            m_sprite_fifo.push_back(Pixel{0, 1, false});
+        u8 low = m_data_low;
+        u8 high = m_data_high;
+
+        //Horizontal flip, the leftmost pixel has to end up in bit 7
+        if((m_current_sprite.attribs >> 5) & 1) {
+            low = reverse_bits(low);
+            high = reverse_bits(high);
         }
 
-        //Mix sprites
-        for(int i = m_sprite_width - 1; i >= 0; i--) {
-            int new_i = i + (8 - m_sprite_width);
-            int rev_i = (m_current_sprite.attribs >> 5) & 1 ? new_i : 7 - new_i;
-            Pixel pixel = m_sprite_fifo[i];
+        //Drop the columns that are off the left side of the screen
+        low <<= 8 - m_sprite_width;
+        high <<= 8 - m_sprite_width;
 
-            if(pixel.color_index == 0 && m_pixel_data[rev_i] != 0) {
-                m_sprite_fifo[i] = Pixel{m_pixel_data[rev_i], (u8)(1 + ((m_current_sprite.attribs >> 4) & 1)), ((m_current_sprite.attribs >> 7) & 1) == 1};
-            }
-        }
+        m_sprite_fifo.mix(low, high, (m_current_sprite.attribs >> 4) & 1, (m_current_sprite.attribs >> 7) & 1);
 
         m_fetch_sprites = false;
         m_state = READ_TILE_ID;
     } else if(m_bg_fifo.size() <= 8) {
-        for(int i = 7; i >= 0; i--) {
-            m_bg_fifo.push_back(Pixel{m_pixel_data[i], 0, false});
-        }
+        m_bg_fifo.push(m_data_low, m_data_high);
 
         if(!m_x_scrolled && !m_fetch_window) {
             //Only use the lower 3 bits of SCX for "fine scrolling"
-            for(int i = 0; i < (m_ppu.m_scx & 7); i++) {
-                m_bg_fifo.pop_front();
-            }
+            m_bg_fifo.drop(m_ppu.m_scx & 7);
             m_x_scrolled = true;
         } else if(m_fetch_window && !m_x_scrolled && m_ppu.m_wx < 7) {
             //Scroll based on how much it is offscreen
-            for(int i = 0; i < (7 - m_ppu.m_wx); i++) {
-                m_bg_fifo.pop_front();
-            }
+            m_bg_fifo.drop(7 - m_ppu.m_wx);
             m_x_scrolled = true;
         }
 
@@ -236,32 +253,54 @@ void Fetcher::push_to_fifo() {
     }
 }
 
-void Fetcher::vblank() {
-    m_window_y = 0;
-}
-
 
 //--------------- PPU ----------------//
 
-PPU::PPU(CPU &cpu, Memory &mem, Clock &clock, VideoDevice &video_device, bool stub_ly) 
-: m_cpu(cpu), m_mem(mem), m_clock(clock), m_video_device(video_device), m_stub_ly(stub_ly), m_fetcher(*this) {
+PPU::PPU(CPU &cpu, Memory &mem, Scheduler &scheduler, VideoDevice &video_device, bool stub_ly, bool scanline) 
+: m_fetcher(*this), m_scanline(scanline), m_cpu(cpu), m_mem(mem), m_scheduler(scheduler), m_video_device(video_device), m_stub_ly(stub_ly) {
+    m_scheduler.set_handler(PPU_MODE, [&]() { handle_event(); });
+    m_scheduler.set_handler(DMA_END, [&]() { end_dma(); });
+    m_scheduler.set_handler(PPU_HBLANK, [&]() { check_hblank(); });
     reset();
+
+    //Start from a known VRAM so the decoded tiles match it
+    memset(m_vram, 0, sizeof(m_vram));
+    memset(m_tiles, 0, sizeof(m_tiles));
 }
 
 void PPU::reset() {
     m_lcdc = 0xff;
+    m_ly = 0;
     m_state = HBLANK;
+    m_disable_oam = false;
+    m_window_line = 0;
+    m_fifo_line = true;
+    m_oam_dirty = true;
+    m_skipped = 0;
+    m_skip_frame = false;
+
+    //The scheduler gets reset before this, so it's starting from the beginning of a line
+    m_line_start = m_scheduler.now();
+    m_synced = m_line_start;
+    m_scheduler.schedule(PPU_MODE, m_line_start + 456);
 }
 
 //TODO: Blocks certain writes during certain modes
 void PPU::write(u16 address, u8 value) {
     u8 old;
+    sync();
+
+    if(m_state == PIXEL_TRANSFER && !m_fifo_line && changes_line(address, value)) {
+        switch_to_fifo();
+    }
 
     //MSVC doesn't support case ranges
     if(in_range<u16>(address, 0x8000, 0x9FFF)) {
         m_vram[address - 0x8000] = value;
+        if(address <= 0x97FF) decode_tile_row(address);
     } else if(in_range<u16>(address, 0xFE00, 0xFE9f)) {
         if(!m_disable_oam) m_oam[address - 0xFE00] = value;
+        m_oam_dirty = true;
     }
     
     switch(address) {
@@ -270,10 +309,11 @@ void PPU::write(u16 address, u8 value) {
         // case 0xFE00 ... 0xFE9F : if(!m_disable_oam) m_oam[address - 0xFE00] = value;
         // break;
 
-        case 0xFF40 : m_lcdc = value;
+        case 0xFF40 : set_lcdc(value);
         break;
         case 0xFF41 : m_stat = (value & 0b11111000) | (m_stat & 0b00000111); //Bits 0-2 are read-only
             //m_cpu.request_interrupt(LCD_STAT_INT); //Writing to the stat register calls a stat interrupt for some reason
+            if(m_lcdc >> 7) check_stat_int(); //A newly enabled source can trigger right away
         break;
         case 0xFF42 : m_scy = value;
         break;
@@ -283,7 +323,7 @@ void PPU::write(u16 address, u8 value) {
         break;
         case 0xFF45 : m_lyc = value; check_stat_int(); //LY=LYC is checked after a write to LYC
         break;
-        case 0xFF46 : m_dma = value; m_dma_start = true;
+        case 0xFF46 : m_dma = value; start_dma();
         break;
         case 0xFF47 : m_bgp = value;
         break;
@@ -299,6 +339,8 @@ void PPU::write(u16 address, u8 value) {
 }
 
 u8 PPU::read(u16 address) {
+    sync();
+
     if(in_range<u16>(address, 0x8000, 0x9FFF)) {
         return m_vram[address - 0x8000];
     } else if(in_range<u16>(address, 0xFE00, 0xFE9f)) {
@@ -336,45 +378,57 @@ u8 PPU::read(u16 address) {
     return 0;
 }
 
-void PPU::step() {
-    m_clock.add_t(1);
-    m_ticks++;
-
-    bool lcd_enabled = m_lcdc >> 7;
+//Runs the PPU up to the current time. Nothing gets ticked along with the rest of the system, this only happens when the
+//CPU accesses the PPU and before each of the PPU's events.
+void PPU::sync() {
+    u64 now = m_scheduler.now();
 
-    //LCD disabled
-    if(!lcd_enabled) {
-        if(!m_disabled) {
-            m_ly = 0;
-            m_ticks = 0;
-            m_state = HBLANK;
+    if(now > m_synced) {
+        tick(now - m_synced);
+        m_synced = now;
+    }
+}
 
-            //Clear screen to white
-            m_video_device.clear_screen(0xffffffff);
-            m_video_device.present_screen();
+//Only pixel transfer needs to be run a dot at a time, everything else happens in handle_event
+void PPU::tick(u64 cycles) {
+    while(m_state == PIXEL_TRANSFER && m_fifo_line && cycles > 0) {
+        pixel_transfer();
+        cycles--;
+    }
+}
 
-            m_disabled = true;
-            //LOG_INFO("LCD disabled");
-        }
+//Catches up to see if the FIFO has finished the line, otherwise waits for the next time it could have
+void PPU::check_hblank() {
+    sync();
 
-        return;
-    } else {
-        //if(m_disabled) LOG_INFO("LCD Enabled");
-        m_disabled = false;
+    if(m_state == PIXEL_TRANSFER && m_fifo_line) {
+        m_scheduler.schedule_in(PPU_HBLANK, 160 - m_lcd_x); //At most one pixel goes out per dot
     }
+}
 
-    //I'll just put this here
-    update_dma();
+//Called at the end of OAM search, at the end of each line, and for the odd timing of line 153. Also at the end of pixel
+//transfer when the scanline renderer has the line.
+void PPU::handle_event() {
+    sync();
 
     switch(m_state) {
         case OAM_SEARCH : oam_search();
         break;
-        case PIXEL_TRANSFER : pixel_transfer();
+        case PIXEL_TRANSFER :
+            if(m_skip_frame) {
+                m_window_line += window_on_line(); //Still has to count the lines the window would've been on
+            } else {
+                render_line();
+            }
+
+            m_state = HBLANK;
+            m_scheduler.schedule(PPU_MODE, m_line_start + 456);
         break;
         case HBLANK : hblank();
         break;
         case VBLANK : vblank();
         break;
+        default : break;
     }
 
     //Update mode in STAT register
@@ -382,19 +436,53 @@ void PPU::step() {
     check_stat_int();
 }
 
-void PPU::update_dma() {
-    if(m_dma_start) {
-        m_mem.dma_start(m_dma);
-        m_dma_start = false;
-        m_dma_cycles = 0;
-    } else if(m_dma_cycles < 160) {
-        m_disable_oam = false;
-        m_mem.dma_step();
-        m_disable_oam = true;
-        m_dma_cycles++;
-    } else {
-        m_disable_oam = false;
+//Redoes the row of the tile that the byte belongs to
+void PPU::decode_tile_row(u16 address) {
+    u16 offset = (address - 0x8000) & ~1;
+    decode_2bpp(m_vram[offset], m_vram[offset + 1], m_tiles[offset / 16][(offset & 0xF) / 2]);
+}
+
+void PPU::set_lcdc(u8 value) {
+    bool was_enabled = m_lcdc >> 7;
+    bool lcd_enabled = value >> 7;
+    m_oam_dirty |= ((m_lcdc ^ value) >> 2) & 1; //Sprite height
+    m_lcdc = value;
+
+    if(was_enabled && !lcd_enabled) {
+        m_ly = 0;
+        m_state = HBLANK;
+        m_scheduler.cancel(PPU_MODE);
+        m_scheduler.cancel(PPU_HBLANK);
+
+        //Clear screen to white
+        m_video_device.clear_screen(0xffffffff);
+        m_video_device.present_screen();
+    } else if(!was_enabled && lcd_enabled) {
+        //Starts out in HBlank for the first line
+        m_line_start = m_scheduler.now();
+        m_scheduler.schedule(PPU_MODE, m_line_start + 456);
+
+        m_stat = (m_stat & 0xfc) | m_state;
+        check_stat_int();
+    }
+}
+
+//The whole transfer is done at once, OAM is just inaccessible until it would have finished
+void PPU::start_dma() {
+    u16 source = m_dma << 8;
+
+    m_disable_oam = false;
+    for(u16 i = 0; i < 160; i++) {
+        m_oam[i] = m_mem.read(source + i);
     }
+    m_disable_oam = true;
+    m_oam_dirty = true;
+
+    m_scheduler.schedule_in(DMA_END, 161);
+}
+
+void PPU::end_dma() {
+    m_disable_oam = false;
 }
 
 void PPU::check_stat_int() {
@@ -418,47 +506,67 @@ void PPU::check_stat_int() {
     }
 }
 
-void PPU::oam_search() {
-    if(m_ticks == 80) {
-        m_lcd_x = 0;
-        u8 sprite_height = (m_lcdc >> 2) & 1 ? 16 : 8;
-        bool obj_enable = (m_lcdc >> 1) & 1;
-        std::vector<ObjectData> sprites;
-
-        //Search OAM for sprites that are on this line
-        if(obj_enable) {
-            for(u16 i = 0; i <= 0x9F; i += 4) {
-                u8 y_pos = m_oam[i];
-                u8 x_pos = m_oam[i + 1];
-
-                //Don't add sprites that aren't visible
-                if(x_pos == 0 || y_pos == 0) {
-                    continue;
-                }
+//Puts every sprite on the lines it covers, in OAM order and keeping only the first 10 on each line
+void PPU::bin_sprites() {
+    u8 sprite_height = (m_lcdc >> 2) & 1 ? 16 : 8;
+    memset(m_line_object_count, 0, sizeof(m_line_object_count));
 
-                //Check the y to see if it's on this line
-                if(y_pos <= m_ly + 16 && m_ly + 16 < y_pos + sprite_height) {
-                    sprites.push_back(ObjectData{(u16)(0xFE00 + i), y_pos, x_pos, m_oam[i + 2], m_oam[i + 3]});
-                    
-                    //No more than 10 sprites a line
-                    if(sprites.size() >= 10) {
-                        break;
-                    }
-                }
+    for(u8 i = 0; i < 40; i++) {
+        u8 y_pos = m_oam[i * 4];
+        u8 x_pos = m_oam[i * 4 + 1];
+
+        //Don't add sprites that aren't visible
+        if(x_pos == 0 || y_pos == 0) {
+            continue;
+        }
+
+        for(int line = std::max(y_pos - 16, 0); line < std::min(y_pos - 16 + sprite_height, GB_SCREEN_HEIGHT); line++) {
+            if(m_line_object_count[line] < 10) {
+                m_line_objects[line][m_line_object_count[line]++] = i;
             }
+        }
+    }
 
-            //Sort sprites by x and address
-            std::sort(sprites.begin(), sprites.end(), [](const ObjectData &first, const ObjectData &second) {
-                if(first.x == second.x) {
-                    return first.oam_address > second.oam_address;
-                } else {
-                    return first.x > second.x;
-                }
-            });
+    m_oam_dirty = false;
+}
+
+void PPU::oam_search() {
+    m_lcd_x = 0;
+    bool obj_enable = (m_lcdc >> 1) & 1;
+    LineSprites &sprites = m_line_sprites;
+    sprites.count = 0;
+
+    //Look up the sprites that are on this line
+    if(obj_enable && m_ly < GB_SCREEN_HEIGHT) {
+        if(m_oam_dirty) {
+            bin_sprites();
+        }
+
+        for(u8 i = 0; i < m_line_object_count[m_ly]; i++) {
+            u16 offset = m_line_objects[m_ly][i] * 4;
+            sprites.sprites[sprites.count++] = ObjectData{(u16)(0xFE00 + offset), m_oam[offset], m_oam[offset + 1], m_oam[offset + 2], m_oam[offset + 3]};
         }
 
+        //Sort sprites by x and address
+        std::sort(sprites.sprites, sprites.sprites + sprites.count, [](const ObjectData &first, const ObjectData &second) {
+            if(first.x == second.x) {
+                return first.oam_address > second.oam_address;
+            } else {
+                return first.x > second.x;
+            }
+        });
+    }
+
+    m_state = PIXEL_TRANSFER;
+
+    if(m_scanline) {
+        m_fifo_line = false;
+        m_scheduler.schedule(PPU_MODE, m_line_start + 80 + transfer_length());
+    } else {
+        m_fifo_line = true;
         m_fetcher.start(sprites);
-        m_state = PIXEL_TRANSFER;
+        m_scheduler.schedule(PPU_MODE, m_line_start + 456);
+        m_scheduler.schedule(PPU_HBLANK, m_line_start + 80 + 160);
     }
 }
 
@@ -468,65 +576,222 @@ void PPU::pixel_transfer() {
     //Don't push pixels while the fifo has less than or equal to 8 pixels or is fetching sprite data
     if(m_fetcher.fifo_size() > 8 && !m_fetcher.disabled()) {
         Pixel pixel = m_fetcher.fifo_pop();
-        bool bg_enabled = m_lcdc & 1;
 
-        //Index the background palette
-        u8 palette = pixel.palette == 0 ? m_bgp : pixel.palette == 1 ? m_obp0 : m_obp1;
-        u8 index = palette >> (pixel.color_index * 2) & 3;
-        u32 color = bg_enabled ? shades[index] : pixel.palette != 0 ? shades[index] : shades[0];
-        m_video_device.draw_pixel(color, m_lcd_x, m_ly);
+        //The fetcher still has to run on skipped frames, it's what decides how long the line takes
+        if(!m_skip_frame) {
+            bool bg_enabled = m_lcdc & 1;
+
+            //Index the background palette
+            u8 palette = pixel.palette == 0 ? m_bgp : pixel.palette == 1 ? m_obp0 : m_obp1;
+            u8 index = palette >> (pixel.color_index * 2) & 3;
+            m_line_shades[m_lcd_x] = bg_enabled ? index : pixel.palette != 0 ? index : 0;
+        }
 
         m_lcd_x++;
     }
 
     if(m_lcd_x == 160) {
+        if(!m_skip_frame) {
+            m_video_device.draw_indices(m_ly, m_line_shades, DMG_SHADES);
+        }
+
+
         m_state = HBLANK;
+        m_stat = (m_stat & 0xfc) | m_state;
+        check_stat_int();
     }
 }
 
 void PPU::hblank() {
-    if(m_ticks == 456) {
-        m_ticks = 0;
-        m_ly++;
-        m_ly_lyc = m_ly == m_lyc;
+    m_line_start += 456;
+    m_ly++;
+    m_ly_lyc = m_ly == m_lyc;
 
-        //Update lyc=ly in STAT register
-        m_stat = m_stat | (m_ly_lyc ? 4 : 0);
+    //Update lyc=ly in STAT register
+    m_stat = m_stat | (m_ly_lyc ? 4 : 0);
 
-        if(m_ly == 144) {
-            m_state = VBLANK;
-            m_cpu.request_interrupt(VBLANK_INT);
+    if(m_ly == 144) {
+        m_state = VBLANK;
+        m_cpu.request_interrupt(VBLANK_INT);
+        m_window_line = 0;
+
+        if(!m_skip_frame) {
             m_video_device.present_screen();
-            m_fetcher.vblank();
-        } else {
-            m_state = OAM_SEARCH;
         }
+
+        //Decide on the next frame
+        m_skipped = m_skip_frame ? m_skipped + 1 : 0;
+        m_skip_frame = m_frame_skip == FRAME_SKIP_ALL || m_skipped < m_frame_skip;
+
+        m_scheduler.schedule(PPU_MODE, m_line_start + 456);
+    } else {
+        m_state = OAM_SEARCH;
+        m_scheduler.schedule(PPU_MODE, m_line_start + 80);
     }
 }
 
 void PPU::vblank() {
+    //LY only reads 153 for the first dot of the line
     if(m_ly == 153) {
         m_ly = 0;
         m_ly_lyc = m_ly == m_lyc;
     
         //Update lyc=ly in STAT register
         m_stat = m_stat | (m_ly_lyc ? 4 : 0);
+        m_scheduler.schedule(PPU_MODE, m_line_start + 456);
+        return;
+    }
+
+    m_line_start += 456;
+
+    if(m_ly == 0) {
+        m_state = OAM_SEARCH;
+        m_scheduler.schedule(PPU_MODE, m_line_start + 80);
+        return;
+    }
+
+    m_ly++;
+    m_ly_lyc = m_ly == m_lyc;
+
+    //Update lyc=ly in STAT register
+    m_stat = m_stat | (m_ly_lyc ? 4 : 0);
+    m_scheduler.schedule(PPU_MODE, m_line_start + (m_ly == 153 ? 1 : 456));
+}
+
+//--------------- Scanline Renderer ----------------//
+
+bool PPU::window_on_line() {
+    return (m_lcdc >> 5) & 1 && m_ly >= m_wy && m_wx <= 166;
+}
+
+//Exactly as long as the FIFO would take to put out the line, found by running the fetcher without drawing anything. The
+//window's line counter is left for render_line to count.
+u64 PPU::transfer_length() {
+    u8 window_line = m_window_line;
+    u64 length = m_fetcher.run_line(m_line_sprites);
+    m_window_line = window_line;
+
+    return length;
+}
+
+//Whether a write would change how the rest of the line looks
+bool PPU::changes_line(u16 address, u8 value) {
+    if(in_range<u16>(address, 0x8000, 0x9FFF)) {
+        return m_vram[address - 0x8000] != value;
+    }
+
+    switch(address) {
+        case 0xFF40 : case 0xFF42 : case 0xFF43 : case 0xFF47 : case 0xFF48 : case 0xFF49 : case 0xFF4A : case 0xFF4B :
+            return read(address) != value;
+        default :
+            return false;
     }
+}
 
-    if(m_ticks == 456) {
-        if(m_ly == 0) {
-            m_state = OAM_SEARCH;
-            m_ticks = 0;
-            return;
+//Redoes the line so far with the FIFO, using the registers from before the write, then lets the FIFO finish it off
+void PPU::switch_to_fifo() {
+    m_fifo_line = true;
+    m_fetcher.restart(m_line_sprites);
+    m_scheduler.schedule(PPU_MODE, m_line_start + 456);
+
+    tick(m_scheduler.now() - (m_line_start + 80));
+    check_hblank();
+}
+
+//Draws the whole line at once. Gives the same pixels as the FIFO as long as nothing changed during pixel transfer.
+void PPU::render_line() {
+    bool bg_enabled = m_lcdc & 1;
+    bool signed_addressing = !((m_lcdc >> 4) & 1);
+    u16 tile_address = signed_addressing ? 0x9000 : 0x8000;
+
+    //Background and window color indices
+    u8 bg_line[GB_SCREEN_WIDTH];
+    u8 y = m_scy + m_ly;
+    u16 bg_map = ((m_lcdc >> 3) & 1 ? 0x9C00 : 0x9800) + (y / 8) * 32;
+    u16 window_map = ((m_lcdc >> 6) & 1 ? 0x9C00 : 0x9800) + (m_window_line / 8) * 32;
+    bool window = window_on_line();
+    int window_x = window ? m_wx - 7 : GB_SCREEN_WIDTH;
+
+    //A tile at a time, or whatever is left of it before the window or the edge of the screen
+    for(int x = 0; x < GB_SCREEN_WIDTH;) {
+        u16 map_address;
+        u8 tile_line;
+        u8 tile_x;
+        int end;
+
+        if(x >= window_x) {
+            u8 window_col = x - window_x;
+            map_address = window_map + (window_col / 8) % 32;
+            tile_line = m_window_line % 8;
+            tile_x = window_col % 8;
+            end = GB_SCREEN_WIDTH;
+        } else {
+            u8 bg_x = m_scx + x;
+            map_address = bg_map + bg_x / 8;
+            tile_line = y % 8;
+            tile_x = bg_x % 8;
+            end = std::min(window_x, GB_SCREEN_WIDTH);
         }
 
-        m_ticks = 0;
-        m_ly++;
-        m_ly_lyc = m_ly == m_lyc;
+        u8 tile_id = m_vram[map_address - 0x8000];
+        const u8 *row = tile_row(tile_address + (signed_addressing ? (s8)tile_id * 16 : tile_id * 16) + tile_line * 2);
+        int count = std::min(8 - tile_x, end - x);
 
-        //Update lyc=ly in STAT register
-        m_stat = m_stat | (m_ly_lyc ? 4 : 0);
+        memcpy(&bg_line[x], row + tile_x, count);
+        x += count;
+    }
+
+    if(window) {
+        m_window_line++;
+    }
+
+    //Sprites, lowest x first, and earlier sprites keep the pixels they already have
+    Pixel sprite_line[GB_SCREEN_WIDTH] = {};
+
+    if((m_lcdc >> 1) & 1) {
+        for(int i = m_line_sprites.count - 1; i >= 0; i--) {
+            const ObjectData *sprite = &m_line_sprites.sprites[i];
+            u8 sprite_line_y = m_ly + 16 - sprite->y;
+
+            //Vertical flip
+            if((sprite->attribs >> 6) & 1) {
+                sprite_line_y = (m_lcdc >> 2) & 1 ? 15 - sprite_line_y : 7 - sprite_line_y;
+            }
+
+            //Ignore first bit of tile id if it is double height
+            u8 sprite_tile_id = (m_lcdc >> 2) & 1 ? sprite->tile_id & ~1 : sprite->tile_id;
+            const u8 *row = tile_row(0x8000 + sprite_tile_id * 16 + sprite_line_y * 2);
+            bool x_flip = (sprite->attribs >> 5) & 1;
+
+            for(int col = 0; col < 8; col++) {
+                int x = sprite->x - 8 + col;
+
+                if(x < 0 || x >= GB_SCREEN_WIDTH || sprite_line[x].color_index != 0) {
+                    continue;
+                }
+
+                u8 color_index = row[x_flip ? 7 - col : col];
+                sprite_line[x] = Pixel{color_index, (u8)(1 + ((sprite->attribs >> 4) & 1)), ((sprite->attribs >> 7) & 1) == 1};
+            }
+        }
     }
+
+    //Mix them the same way the FIFO does, with the background shades all 0 when it's disabled
+    u8 palettes[3] = {bg_enabled ? m_bgp : (u8)0, m_obp0, m_obp1};
+    u8 line_shades[GB_SCREEN_WIDTH];
+
+    for(int x = 0; x < GB_SCREEN_WIDTH; x++) {
+        Pixel pixel = Pixel{bg_line[x], 0, false};
+        Pixel sprite_pixel = sprite_line[x];
+
+        if(sprite_pixel.color_index != 0 && !(sprite_pixel.priority && pixel.color_index != 0)) {
+            pixel = sprite_pixel;
+        }
+
+        line_shades[x] = (palettes[pixel.palette] >> (pixel.color_index * 2)) & 3;
+    }
+
+    m_video_device.draw_indices(m_ly, line_shades, DMG_SHADES);
 }
 
 } //namespace sb
\ No newline at end of file
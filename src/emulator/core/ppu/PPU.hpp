@@ -7,8 +7,7 @@
 #include "emulator/core/Memory.hpp"
 #include "emulator/device/VideoDevice.hpp"
 
-#include <deque>
-#include <vector>
+#include <algorithm>
 
 #define GB_SCREEN_WIDTH 160
 #define GB_SCREEN_HEIGHT 144
@@ -16,6 +15,8 @@
 
 namespace sb {
 
+constexpr u32 FRAME_SKIP_ALL = 0xFFFFFFFF; //Never draws anything, only the timing is kept
+
 //Numbers correspond to numbers in the STAT register
 enum PPU_State {
     OAM_SEARCH = 2, PIXEL_TRANSFER = 3, HBLANK = 0, VBLANK = 1
@@ -46,6 +47,32 @@ struct ObjectData {
     }
 };
 
+//Up to 10 sprites on a line, sorted so the one the fetcher reaches first is at the back
+struct LineSprites {
+    ObjectData sprites[10];
+    u8 count = 0;
+
+    bool empty() const { return count == 0; }
+    const ObjectData& back() const { return sprites[count - 1]; }
+    void pop_back() { count--; }
+};
+
+//Everything that decides how long the fetcher takes to put out a line, the rest only changes which pixels come out
+struct LineTiming {
+    u8 ticks;        //Where the fetcher was in a fetch when the line started
+    u8 fine_scroll;
+    u8 lcdc;         //Only the window and sprite enables
+    u8 wx;
+    bool wy_triggered;
+    u8 sprite_count;
+    u8 sprite_x[10];
+
+    bool operator==(const LineTiming &other) const {
+        return ticks == other.ticks && fine_scroll == other.fine_scroll && lcdc == other.lcdc && wx == other.wx &&
+        wy_triggered == other.wy_triggered && sprite_count == other.sprite_count && std::equal(sprite_x, sprite_x + sprite_count, other.sprite_x);
+    }
+};
+
 //Pixel data
 struct Pixel {
     u8 color_index;
@@ -59,16 +86,69 @@ struct Pixel {
     }
 };
 
+//Up to 16 pixels held in shift registers the way the hardware does it, one register per bit of the color index plus one
+//for the sprite palette and one for sprite priority. The front of the FIFO is the top bit.
+class PixelFIFO {
+private:
+
+    u16 m_low;
+    u16 m_high;
+    u16 m_palette;  //Sprites only, set for OBP1
+    u16 m_priority; //Sprites only
+    u8 m_size;
+
+public:
+
+    PixelFIFO() { clear(); }
+
+    u8 size() { return m_size; }
+    bool empty() { return m_size == 0; }
+    void clear() { m_low = m_high = m_palette = m_priority = 0; m_size = 0; }
+
+    //Appends a row of a tile, the leftmost pixel is bit 7. Only fits while there are 8 or less pixels in the FIFO.
+    void push(u8 low, u8 high) {
+        m_low |= low << (8 - m_size);
+        m_high |= high << (8 - m_size);
+        m_size += 8;
+    }
+
+    //Puts a sprite row over the first 8 pixels, only where there isn't already a sprite pixel that isn't transparent
+    void mix(u8 low, u8 high, bool palette, bool priority) {
+        u16 mask = ~(m_low | m_high) & ((low | high) << 8);
+
+        m_low |= (low << 8) & mask;
+        m_high |= (high << 8) & mask;
+        m_palette = (m_palette & ~mask) | (palette ? mask : 0);
+        m_priority = (m_priority & ~mask) | (priority ? mask : 0);
+        m_size = m_size < 8 ? 8 : m_size;
+    }
+
+    Pixel pop() {
+        Pixel pixel = Pixel{(u8)((m_low >> 15) | ((m_high >> 15) << 1)), (u8)(m_palette >> 15), (m_priority >> 15) == 1};
+        drop(1);
+
+        return pixel;
+    }
+
+    void drop(u8 count) {
+        m_low <<= count;
+        m_high <<= count;
+        m_palette <<= count;
+        m_priority <<= count;
+        m_size -= count;
+    }
+};
+
 
 class Fetcher {
 private:
 
     //FIFOs
-    std::deque<Pixel> m_bg_fifo;
-    std::deque<Pixel> m_sprite_fifo;
+    PixelFIFO m_bg_fifo;
+    PixelFIFO m_sprite_fifo;
 
     //Sprite stuff
-    std::vector<ObjectData> m_sprites;
+    LineSprites m_sprites;
     ObjectData m_current_sprite;
     u8 m_sprite_line;
     u8 m_sprite_width;
@@ -76,8 +156,13 @@ private:
 
     Fetcher_State m_state;
     u8 m_ticks;
+    u8 m_line_ticks; //m_ticks when the line started, so the line can be started over
+
+    //Lines usually take as long as the one before, so the last one run_line timed is kept
+    LineTiming m_last_timing;
+    u8 m_last_end_ticks;
+    u16 m_last_dots;
     u8 m_line_x;
-    u8 m_window_y;
     bool m_wy_triggered;
     bool m_fetch_window;
 
@@ -86,7 +171,8 @@ private:
     u8 m_tile_id;
     u16 m_map_address;
     u16 m_tile_address;
-    u8 m_pixel_data[8];
+    u8 m_data_low;
+    u8 m_data_high;
     bool m_x_scrolled;
     bool m_signed_addressing;
 
@@ -106,9 +192,10 @@ public:
     Pixel fifo_pop();
     usize fifo_size();
     bool disabled();
-    void start(std::vector<ObjectData> sprites);
+    void start(const LineSprites &sprites);
+    void restart(const LineSprites &sprites);
     void step();
-    void vblank();
+    u16 run_line(const LineSprites &sprites);
 };
 
 
@@ -118,6 +205,12 @@ private:
     //Memory
     u8 m_vram[8192];   //0x8000 - 0x9FFF | Video RAM
     u8 m_oam[160];     //0xFE00 - 0xFE9F | Sprites  
+    u8 m_tiles[384][8][8]; //Tile data in 0x8000 - 0x97FF with one color index per pixel, updated on every VRAM write
+
+    //OAM indices of the first 10 sprites on each line, rebuilt at the next OAM search after OAM or the sprite height changes
+    u8 m_line_objects[GB_SCREEN_HEIGHT][10];
+    u8 m_line_object_count[GB_SCREEN_HEIGHT];
+    bool m_oam_dirty;
 
     //IO Registers
     u8 m_lcdc;         //0xFF40 | LCD Ctrl  
@@ -135,43 +228,70 @@ private:
 
     Fetcher m_fetcher;
     PPU_State m_state;    
-    u16 m_ticks;
+    u64 m_line_start; //Timestamp of the start of the current line
+    u64 m_synced;     //Timestamp the dot by dot work has been done up to
     u8 m_lcd_x;
+    u8 m_line_shades[GB_SCREEN_WIDTH]; //What the FIFO has pushed so far on the current line, handed over at the end
+    u8 m_window_line; //Window's own line counter, only goes up on lines the window was drawn on
+
+    //Scanline renderer
+    LineSprites m_line_sprites; //What OAM search found for the current line
+    bool m_scanline;  //Draw whole lines at the end of pixel transfer instead of running the FIFO every dot
+    bool m_fifo_line; //The current line is going through the FIFO, either always or because it changed mid-line
     bool m_last_stat_irq;
     bool m_ly_lyc;
-    bool m_disabled;
-    bool m_dma_start;
-    u16 m_dma_cycles;
+
+    //Frame skip, skipped frames keep all the timing but don't fetch or draw anything they don't have to
+    u32 m_frame_skip = 0; //Frames skipped after each one that's drawn
+    u32 m_skipped;    //Frames skipped since the last one that was drawn
+    bool m_skip_frame;
 
     bool m_disable_oam;
     bool m_disable_vram;
 
     CPU &m_cpu;
     Memory &m_mem; //For DMA
-    Clock &m_clock;
+    Scheduler &m_scheduler;
     VideoDevice &m_video_device;
 
     //Extra options
     bool m_stub_ly;
 
-    void update_dma();
+    void decode_tile_row(u16 address);
+    u8 vram(u16 address) { return m_vram[address - 0x8000]; }
+    const u8* tile_row(u16 address) { return m_tiles[(address - 0x8000) / 16][(address & 0xF) / 2]; }
+
+    bool window_on_line();
+    u64 transfer_length();
+    bool changes_line(u16 address, u8 value);
+    void switch_to_fifo();
+    void render_line();
+
+    void start_dma();
+    void end_dma();
     void check_stat_int();
+    void set_lcdc(u8 value);
     
+    void bin_sprites();
     void oam_search();
     void pixel_transfer();
     void hblank();
     void vblank();
+    void handle_event();
+    void check_hblank();
 
 public:
 
-    PPU(CPU &cpu, Memory &mem, Clock &clock, VideoDevice &video_device, bool stub_ly = false);
+    PPU(CPU &cpu, Memory &mem, Scheduler &scheduler, VideoDevice &video_device, bool stub_ly = false, bool scanline = false);
 
     void reset();
     void write(u16 address, u8 value);
     u8 read(u16 address);
     
-    void step();
-    void cycle_empty() { m_clock.add_t(1); }
+    void tick(u64 cycles);
+    void sync();
+    void delay(u64 cycles) { m_line_start += cycles; m_synced += cycles; }
+    void set_frame_skip(u32 frames) { m_frame_skip = frames; }
 
     friend class Fetcher; //Should probably change this to memory accesses
 };
@@ -0,0 +1,85 @@
+#include "TileDecode.hpp"
+#include "common/Defines.hpp"
+
+#include <cstring>
+
+#if defined(SB_AVX2)
+    #include <immintrin.h>
+#elif defined(SB_SSE2)
+    #include <emmintrin.h>
+#endif
+
+
+namespace sb {
+
+void decode_2bpp_scalar(u8 low, u8 high, u8 *out) {
+    for(int i = 0; i < 8; i++) {
+        out[i] = ((low >> (7 - i)) & 1) | (((high >> (7 - i)) & 1) << 1);
+    }
+}
+
+void shades_to_rgba_scalar(const u8 *shades, const u32 *colors, u32 *out, usize count) {
+    for(usize i = 0; i < count; i++) {
+        out[i] = colors[shades[i] & 3];
+    }
+}
+
+#if defined(SB_SSE2)
+
+//The low plane goes in the first 8 bytes and the high plane in the last 8, each byte tests the bit for its own pixel
+void decode_2bpp(u8 low, u8 high, u8 *out) {
+    const __m128i bits = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+
+    __m128i planes = _mm_unpacklo_epi64(_mm_set1_epi8(low), _mm_set1_epi8(high));
+    __m128i set = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(planes, bits), bits), _mm_set1_epi8(1));
+    __m128i indices = _mm_add_epi8(set, _mm_add_epi8(_mm_srli_si128(set, 8), _mm_srli_si128(set, 8)));
+
+    _mm_storel_epi64((__m128i*)out, indices);
+}
+
+void shades_to_rgba(const u8 *shades, const u32 *colors, u32 *out, usize count) {
+    usize i = 0;
+
+#if defined(SB_AVX2)
+    //8 at a time, the shades index straight into the table
+    __m256i table = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)colors));
+
+    for(; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&shades[i])), _mm256_set1_epi32(3));
+        _mm256_storeu_si256((__m256i*)&out[i], _mm256_permutevar8x32_epi32(table, index));
+    }
+#else
+    //4 at a time, SSE2 can't index a table so each color gets picked with a compare
+    const __m128i color[4] = {_mm_set1_epi32(colors[0]), _mm_set1_epi32(colors[1]), _mm_set1_epi32(colors[2]), _mm_set1_epi32(colors[3])};
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; i + 4 <= count; i += 4) {
+        u32 packed;
+        memcpy(&packed, &shades[i], 4);
+
+        __m128i index = _mm_and_si128(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero), _mm_set1_epi32(3));
+        __m128i result = _mm_and_si128(_mm_cmpeq_epi32(index, zero), color[0]);
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(1)), color[1]));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(2)), color[2]));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(3)), color[3]));
+
+        _mm_storeu_si128((__m128i*)&out[i], result);
+    }
+#endif
+
+    shades_to_rgba_scalar(&shades[i], colors, &out[i], count - i);
+}
+
+#else
+
+void decode_2bpp(u8 low, u8 high, u8 *out) {
+    decode_2bpp_scalar(low, high, out);
+}
+
+void shades_to_rgba(const u8 *shades, const u32 *colors, u32 *out, usize count) {
+    shades_to_rgba_scalar(shades, colors, out, count);
+}
+
+#endif
+
+} //namespace sb
\ No newline at end of file
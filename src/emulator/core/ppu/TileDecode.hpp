@@ -0,0 +1,20 @@
+#ifndef TILE_DECODE_HPP
+#define TILE_DECODE_HPP
+
+#include "common/Types.hpp"
+
+
+namespace sb {
+
+//Turns a row of a tile, given as its two bit planes, into 8 color indices with the leftmost pixel first
+void decode_2bpp(u8 low, u8 high, u8 *out);
+void decode_2bpp_scalar(u8 low, u8 high, u8 *out);
+
+//Looks up each shade, 0-3, in a table of 4 colors
+void shades_to_rgba(const u8 *shades, const u32 *colors, u32 *out, usize count);
+void shades_to_rgba_scalar(const u8 *shades, const u32 *colors, u32 *out, usize count);
+
+} //namespace sb
+
+
+#endif //TILE_DECODE_HPP
\ No newline at end of file
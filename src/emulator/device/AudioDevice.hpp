@@ -12,14 +12,18 @@ protected:
 
     static constexpr int SAMPLE_RATE = 44100;
     static constexpr usize SAMPLE_BUFFER_SIZE = 1024;
-    RingBuffer<s16, SAMPLE_BUFFER_SIZE * 2 + 1> m_sample_buffer; //+1 so the ring buffer doesn't report empty when it's size reaches 1024 * 2
+    RingBuffer<s16, SAMPLE_BUFFER_SIZE * 4> m_sample_buffer; //Room for two buffers of stereo samples
+    double m_sample_rate = SAMPLE_RATE; //What the emulator makes samples at, can be nudged away from the real rate
 
 public:
 
-    void push_sample(s16 left, s16 right) {
-        //Samples are interleaved LRLRLR... for stereo
-        m_sample_buffer.push_back(left);
-        m_sample_buffer.push_back(right);
+    //Samples are interleaved LRLRLR... for stereo, count is in pairs. Whatever doesn't fit is dropped.
+    void push_samples(const s16 *samples, usize count) {
+        m_sample_buffer.push_n(samples, count * 2);
+    }
+
+    double sample_rate() {
+        return m_sample_rate;
     }
 };
 
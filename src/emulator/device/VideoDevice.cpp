@@ -1,28 +1,54 @@
 #include "VideoDevice.hpp"
 #include "common/Defines.hpp"
+#include "emulator/core/ppu/TileDecode.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 
 namespace sb {
 
-VideoDevice::VideoDevice(u32 width, u32 height) : m_internal_width(width), m_internal_height(height) {
-    m_internal_buffer = new u8[width * height * 4];
+VideoDevice::VideoDevice(u32 width, u32 height, PixelFormat format) : m_internal_width(width), m_internal_height(height), m_format(format), m_line(width) {
+    m_internal_buffer = new u8[buffer_size()]();
 }
 
 VideoDevice::~VideoDevice() {
     delete[] m_internal_buffer;
 }
 
+usize VideoDevice::line_size() {
+    switch(m_format) {
+        case FORMAT_SHADES : return m_internal_width;
+        case FORMAT_SHADES_PACKED : return (m_internal_width + 3) / 4;
+        default : return m_internal_width * 4;
+    }
+}
+
+usize VideoDevice::buffer_size() {
+    return line_size() * m_internal_height;
+}
+
+//The shade formats have no colors, so they get cleared to the lightest shade
 void VideoDevice::clear_screen(u32 color) {
+    if(m_format != FORMAT_RGBA) {
+        memset(m_internal_buffer, 0, buffer_size());
+        return;
+    }
+
+    std::fill(m_line.begin(), m_line.end(), color);
+
     for(u32 y = 0; y < m_internal_height; y++) {
-        for(u32 x = 0; x < m_internal_width; x++) {
-            draw_pixel(color, x, y);
-        }
+        draw_line(y, m_line.data());
     }
 }
 
 //Default method, since it doesn't present anything to a window, it just modifies the internal buffer so it doesn't
 //have to be overriden.
 void VideoDevice::draw_pixel(u32 pixel, u32 x, u32 y) {
+    if(m_format != FORMAT_RGBA) {
+        return;
+    }
+
     //You have to times by four here on the width and the x value so it skips 4 components every pixel, like it's supposed to.
     u32 ix = x * 4;
 
@@ -40,4 +66,37 @@ void VideoDevice::draw_pixel(u32 pixel, u32 x, u32 y) {
 
 }
 
+//A whole line of pixels, m_internal_width long
+void VideoDevice::draw_line(u32 y, const u32 *pixels) {
+    if(m_format != FORMAT_RGBA) {
+        return;
+    }
+
+    std::memcpy(&m_internal_buffer[y * m_internal_width * 4], pixels, m_internal_width * 4);
+}
+
+//A whole line of shades from 0-3, only RGBA looks them up in the palette
+void VideoDevice::draw_indices(u32 y, const u8 *indices, const u32 *palette) {
+    u8 *line = &m_internal_buffer[y * line_size()];
+
+    switch(m_format) {
+        case FORMAT_RGBA :
+            shades_to_rgba(indices, palette, m_line.data(), m_internal_width);
+            draw_line(y, m_line.data());
+        break;
+        case FORMAT_SHADES :
+            for(u32 x = 0; x < m_internal_width; x++) {
+                line[x] = indices[x] & 3;
+            }
+        break;
+        case FORMAT_SHADES_PACKED :
+            std::memset(line, 0, line_size());
+
+            for(u32 x = 0; x < m_internal_width; x++) {
+                line[x / 4] |= (indices[x] & 3) << ((x & 3) * 2);
+            }
+        break;
+    }
+}
+
 } //namespace sb
\ No newline at end of file
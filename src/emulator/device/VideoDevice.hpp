@@ -3,26 +3,49 @@
 
 #include "common/Types.hpp"
 
+#include <vector>
+
 
 namespace sb {
 
+//Colors of the four shades on the DMG's screen, lightest first
+constexpr u32 DMG_SHADES[4] = {0xffffffff, 0xb3b3b3ff, 0x6b6b6bff, 0x000000ff};
+
+//How pixels are stored in the internal buffer. The shade formats keep only the shade from 0-3 and leave coloring it to
+//whoever reads the buffer, which is a lot less to move around when nothing needs to see the colors.
+enum PixelFormat {
+    FORMAT_RGBA,         //4 bytes per pixel
+    FORMAT_SHADES,       //1 byte per pixel
+    FORMAT_SHADES_PACKED //2 bits per pixel, 4 pixels to a byte with the leftmost in the lowest bits
+};
+
 //An abstract interface used for drawing pixels to a window. It allows different frontends to be used, i.e. SDL, OpenGL, SFML, etc.
 //Pixels are drawn to an internal buffer, then can be presented / drawn to another buffer used for a window with the present methods,
 //either a line at a time (possibly for HBlank) or the whole screen at a time (for VBlank).
-//The internal buffer is stored in RGBA as an array of 8-bit unsigned integers.
+//In FORMAT_RGBA the internal buffer is stored in RGBA as an array of 8-bit unsigned integers, which is the same as a native
+//u32 per pixel either way around, so whole lines can be copied in at once. draw_pixel and draw_line only work in RGBA,
+//draw_indices works in every format.
 class VideoDevice {
 protected:
 
     u8 *m_internal_buffer;
     u32 m_internal_width, m_internal_height;
+    PixelFormat m_format;
+    std::vector<u32> m_line; //Colors for one line, when indices get turned into RGBA
 
 public:
 
-    VideoDevice(u32 width, u32 height);
+    VideoDevice(u32 width, u32 height, PixelFormat format = FORMAT_RGBA);
     ~VideoDevice();
 
+    PixelFormat format() { return m_format; }
+    usize line_size();   //In bytes
+    usize buffer_size(); //In bytes
+
     void clear_screen(u32 color);
     virtual void draw_pixel(u32 pixel, u32 x, u32 y);
+    virtual void draw_line(u32 y, const u32 *pixels);
+    void draw_indices(u32 y, const u8 *indices, const u32 *palette);
     virtual void present_screen() = 0;
 };
 
@@ -30,7 +53,7 @@ public:
 class NullVideoDevice : public VideoDevice {
 public:
 
-    NullVideoDevice(u32 width, u32 height) : VideoDevice(width, height) { }
+    NullVideoDevice(u32 width, u32 height, PixelFormat format = FORMAT_RGBA) : VideoDevice(width, height, format) { }
 
     void present_screen() override { }
 };
@@ -0,0 +1,142 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include "common/Types.hpp"
+#include "common/Defines.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(SB_SSE2)
+    #include <emmintrin.h>
+#endif
+
+
+//Streaming cubic resampler for interleaved stereo. The last few input frames and the position between them are kept
+//from one call to the next, so buffers join up without clicks. Everything is fixed-point and nothing is allocated, so
+//it's safe to use from the audio callback.
+class Resampler {
+public:
+
+    static constexpr u32 FRAC_BITS = 16;
+    static constexpr u32 ONE = 1 << FRAC_BITS;
+    static constexpr u32 WEIGHT_BITS = 14;
+
+    //The four frames around the position, left channel then right, oldest first. The position always falls between
+    //the middle two.
+    using History = s16[2][4];
+
+    //Catmull-Rom weights for the four frames at position t, they add up to 1 << WEIGHT_BITS. Both channels use the
+    //same ones, so they only get worked out once per frame.
+    static void weights(u32 t, s32 *out) {
+        s32 t1 = t;
+        s32 t2 = (u32)(t * t) >> FRAC_BITS;
+        s32 t3 = (u32)(t2 * t) >> FRAC_BITS;
+
+        //Halved and brought down from FRAC_BITS to WEIGHT_BITS in one shift
+        constexpr u32 SHIFT = FRAC_BITS - WEIGHT_BITS + 1;
+        constexpr s32 ROUND = 1 << (SHIFT - 1);
+
+        out[0] = (-t3 + 2 * t2 - t1 + ROUND) >> SHIFT;
+        out[2] = (-3 * t3 + 4 * t2 + t1 + ROUND) >> SHIFT;
+        out[3] = (t3 - t2 + ROUND) >> SHIFT;
+        out[1] = (1 << WEIGHT_BITS) - out[0] - out[2] - out[3];
+    }
+
+    //One output frame from the history, left and right
+    static void interpolate_scalar(const History &history, u32 t, s16 *out) {
+        s32 w[4];
+        weights(t, w);
+
+        for(u32 channel = 0; channel < 2; channel++) {
+            const s16 *p = history[channel];
+            s32 sum = p[0] * w[0] + p[1] * w[1] + p[2] * w[2] + p[3] * w[3];
+            out[channel] = std::clamp<s32>((sum + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS, -32768, 32767);
+        }
+    }
+
+#if defined(SB_SSE2)
+
+    //Both channels' four taps fit in one register, so a multiply-add and one more add does the whole frame
+    static void interpolate(const History &history, u32 t, s16 *out) {
+        s32 w[4];
+        weights(t, w);
+
+        __m128i taps = _mm_loadu_si128((const __m128i*)history);
+        __m128i weight = _mm_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+
+        //Pairs of taps for each channel, then the pairs added, left ends up in lane 0 and right in lane 2
+        __m128i sums = _mm_madd_epi16(taps, weight);
+        sums = _mm_add_epi32(sums, _mm_srli_epi64(sums, 32));
+        sums = _mm_srai_epi32(_mm_add_epi32(sums, _mm_set1_epi32(1 << (WEIGHT_BITS - 1))), WEIGHT_BITS);
+
+        //Saturating pack does the clamping
+        sums = _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 0, 2, 0));
+        u32 frame = _mm_cvtsi128_si32(_mm_packs_epi32(sums, sums));
+        memcpy(out, &frame, 4);
+    }
+
+#else
+
+    static void interpolate(const History &history, u32 t, s16 *out) {
+        interpolate_scalar(history, t, out);
+    }
+
+#endif
+
+private:
+
+    History m_history;
+    u32 m_position; //How far past m_history[x][1], out of ONE
+
+    void shift_in(s16 left, s16 right) {
+        for(u32 i = 0; i < 3; i++) {
+            m_history[0][i] = m_history[0][i + 1];
+            m_history[1][i] = m_history[1][i + 1];
+        }
+
+        m_history[0][3] = left;
+        m_history[1][3] = right;
+    }
+
+public:
+
+    Resampler() {
+        reset();
+    }
+
+    void reset() {
+        std::fill(&m_history[0][0], &m_history[0][0] + 8, 0);
+        m_position = 0;
+    }
+
+    //Stretches or squeezes in_frames of input to fill exactly out_frames of output. If the input runs out early the
+    //last frame is held, anything left over after the output is full is dropped.
+    void process(const s16 *in, usize in_frames, s16 *out, usize out_frames) {
+        if(out_frames == 0) {
+            return;
+        }
+
+        u32 step = ((u64)in_frames << FRAC_BITS) / out_frames;
+        usize next = 0;
+
+        for(usize i = 0; i < out_frames; i++) {
+            while(m_position >= ONE) {
+                m_position -= ONE;
+
+                if(next < in_frames) {
+                    shift_in(in[next * 2], in[next * 2 + 1]);
+                    next++;
+                } else {
+                    shift_in(m_history[0][3], m_history[1][3]);
+                }
+            }
+
+            interpolate(m_history, m_position, &out[i * 2]);
+            m_position += step;
+        }
+    }
+};
+
+
+#endif //RESAMPLER_HPP
\ No newline at end of file
@@ -3,16 +3,13 @@
 
 #include "emulator/device/AudioDevice.hpp"
 #include "common/Log.hpp"
+#include "Resampler.hpp"
 
 #include <SDL.h>
-#include <mutex>
+#include <atomic>
 
 
-static constexpr int CYCLES_PER_AUDIO_FRAME = 97200; //95 cycles per sample * 1024 samples (stereo)
-
-namespace sb {
-    class Gameboy;
-}
+static constexpr double MAX_RATE_DELTA = 0.005; //How far the sample rate can be pulled to keep the buffer from running dry or overflowing
 
 class SDLAudioDevice : public sb::AudioDevice {
 private:
@@ -20,10 +17,13 @@ private:
     SDL_AudioSpec m_obtained_spec;
     SDL_AudioDeviceID m_device_id;
 
-    sb::Gameboy *m_emu;
-    bool m_sync_to_audio;
+    std::atomic<bool> m_sync_to_audio;
     float m_last_frametime;
 
+    Resampler m_resampler;
+    s16 m_scratch[SAMPLE_BUFFER_SIZE * 4]; //Big enough for everything the ring buffer can hold
+    s16 m_last_frame[2] = {-32767, -32767}; //Last frame played, starts at the level the APU idles at
+
 public:
 
     SDLAudioDevice() {
@@ -36,8 +36,8 @@ public:
         desired.callback = callback;
         desired.userdata = this;
 
-        //Open an audio device
-        m_device_id = SDL_OpenAudioDevice(nullptr, 0, &desired, &m_obtained_spec, 0);
+        //Open an audio device, letting it run at its own rate so SDL doesn't resample on top of the resampler
+        m_device_id = SDL_OpenAudioDevice(nullptr, 0, &desired, &m_obtained_spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 
         if(desired.format != m_obtained_spec.format) {
             LOG_FATAL("[SDLAudio] : Didn't get the requested Signed 16-bit Format!");
@@ -46,6 +46,9 @@ public:
         if(m_device_id == 0) {
             LOG_FATAL("[SDLAudio] : SDL failed to open an audio device! Error: {}", SDL_GetError());
         }
+
+        //The device might not run at the rate that was asked for, make samples at whatever it does run at
+        m_sample_rate = m_obtained_spec.freq;
     }
 
     ~SDLAudioDevice() {
@@ -62,14 +65,8 @@ public:
         SDL_PauseAudioDevice(m_device_id, 1);
     }
 
-    void set_sync(bool value, sb::Gameboy *emu = nullptr) {
+    void set_sync(bool value) {
         m_sync_to_audio = value;
-        
-        if(value && emu == nullptr) {
-            LOG_FATAL("[SDLAudio] : Cannot sync to null Gameboy pointer!");
-        } else {
-            m_emu = emu;
-        }
     }
 
     bool syncing() {
@@ -80,71 +77,41 @@ public:
         return m_last_frametime;
     }
 
-    static u16 resample_linear(u16 *buffer, int buffer_size, int sample_index, int num_samples) {
-        //Get the location within the number of samples between 0 and 1
-        float location = (float)sample_index / (float)num_samples;
-    
-        //Get the location within the buffer of samples, then get the top and bottom integer indexes from it
-        float buffer_loc = location * buffer_size;
-        int loc_top = std::ceil(buffer_loc);
-        int loc_bot = std::floor(buffer_loc);
-        float fractional = buffer_loc - loc_bot;
-
-        u16 top_sample = buffer[loc_top];
-        u16 bot_sample = buffer[loc_bot];
-
-        //Linearly interpolate the samples, based on the fractional part of the location, and return the result
-        u16 new_sample = bot_sample * fractional + top_sample * (1.0f - fractional);
-
-        return new_sample;
+    //Dynamic rate control, called by the emulation thread before every frame. The emulator runs off its own timer, which
+    //never quite matches the sound card's, so the rate samples are made at is nudged up when the buffer is less than half
+    //full and down when it's more. The change in pitch is far too small to hear.
+    void update_rate() {
+        double fill = (double)m_sample_buffer.size() / m_sample_buffer.capacity();
+        m_sample_rate = m_obtained_spec.freq * (1.0 + MAX_RATE_DELTA * (1.0 - 2.0 * fill));
     }
 
     static void callback(void *user_data, u8 *stream, int length) {
         SDLAudioDevice *device = reinterpret_cast<SDLAudioDevice*>(user_data);
-        u16 *_stream = reinterpret_cast<u16*>(stream);
 
-        memset(_stream, 0, length);
+        s16 *out = reinterpret_cast<s16*>(stream);
+        usize samples = length / 2;
 
-        //Run the gameboy until the audio buffer is full, if sync_to_audio is enabled
+        //The emulation thread keeps the buffer about half full, so there's nothing to do here but copy. If it falls
+        //behind, whatever couldn't be filled holds the last frame, dropping to 0 would pop since the APU idles at -32767.
         if(device->m_sync_to_audio) {
-            while(device->m_sample_buffer.size() < SAMPLE_BUFFER_SIZE * 2) {
-                device->m_emu->run_for(75);
-            }
+            //Fill audio stream with samples, length divided by two because it is in bytes and the samples are two bytes long.
+            //They're already interleaved Left and Right, so they can be copied straight in, anything left over is kept for next time.
+            usize popped = device->m_sample_buffer.pop_n(out, samples);
 
-
-            //Fill audio stream with samples, length divided by two because it is in bytes
-            //and the samples are two bytes long, and i is incremented by two because each sample is stereo, Left and Right samples.
-            for(int i = 0; i < length / 2; i += 2) {
-                u16 sample_left = device->m_sample_buffer.pop_front();
-                u16 sample_right = device->m_sample_buffer.pop_front();
-
-                _stream[i] = sample_left;
-                _stream[i + 1] = sample_right;
+            for(usize i = popped; i < samples; i++) {
+                out[i] = device->m_last_frame[i & 1];
             }
         } else {
-            int new_length = length > device->m_sample_buffer.size() ? device->m_sample_buffer.size() : length;
-
-            //Fill arrays with left and right samples
-            int size = device->m_sample_buffer.size() / 2;
-            u16 *left_samples = new u16[size];
-            u16 *right_samples = new u16[size];
-            
-            for(size_t i = 0; i < size; i++) {
-                left_samples[i] = device->m_sample_buffer.pop_front();
-                right_samples[i] = device->m_sample_buffer.pop_front();
-            }
-
-            for(int i = 0; i < new_length / 2; i += 2) {
-                u16 sample_left = resample_linear(left_samples, size, i / 2, SAMPLE_BUFFER_SIZE);
-                u16 sample_right = resample_linear(right_samples, size, i / 2, SAMPLE_BUFFER_SIZE);
-
-                _stream[i] = sample_left;
-                _stream[i + 1] = sample_right;
-            }
+            //When fast forwarding there's a lot more audio than time to play it, so everything that's there gets
+            //squeezed into this buffer
+            usize frames = device->m_sample_buffer.pop_n(device->m_scratch, device->m_sample_buffer.size()) / 2;
+            device->m_resampler.process(device->m_scratch, frames, out, samples / 2);
         }
 
-
-        device->m_sample_buffer.clear();
+        if(samples >= 2) {
+            device->m_last_frame[0] = out[samples - 2];
+            device->m_last_frame[1] = out[samples - 1];
+        }
     }
 };
 
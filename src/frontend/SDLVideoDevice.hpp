@@ -2,36 +2,49 @@
 #define SDL_VIDEO_DEVICE_HPP
 
 #include "emulator/device/VideoDevice.hpp"
+#include "emulator/core/ppu/TileDecode.hpp"
 
 #include <SDL.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 
 class SDLVideoDevice : public sb::VideoDevice {
 private:
 
-    SDL_Surface *m_surface;
     SDL_Renderer *m_renderer;
     SDL_Texture *m_texture;
 
+    //The emulation thread draws shades into the internal buffer, then swaps it with this one to present. The main thread
+    //colors them while uploading from here, so the emulator never touches RGBA at all.
+    u8 *m_ready_buffer;
+    std::mutex m_frame_lock;
+    std::atomic<bool> m_frame_ready;
+
 public:
 
-    SDLVideoDevice(SDL_Window *window, u32 width, u32 height) : sb::VideoDevice(width, height), m_texture(nullptr) {
-        m_surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA8888);
-        m_renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);// | SDL_RENDERER_PRESENTVSYNC);
+    SDLVideoDevice(SDL_Window *window, u32 width, u32 height, bool vsync = false) : sb::VideoDevice(width, height, sb::FORMAT_SHADES), m_frame_ready(false) {
+        m_renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
+        m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        m_ready_buffer = new u8[buffer_size()]();
     }
 
     ~SDLVideoDevice() {
-        SDL_FreeSurface(m_surface);
-
-        if(m_texture != nullptr) {
-            SDL_DestroyTexture(m_texture);
-        }
-
+        delete[] m_ready_buffer;
+        SDL_DestroyTexture(m_texture);
         SDL_DestroyRenderer(m_renderer);
     }
 
     void present_screen() override {
-        memcpy(m_surface->pixels, m_internal_buffer, m_surface->w * m_surface->h * 4);
+        std::lock_guard<std::mutex> lock(m_frame_lock);
+        std::swap(m_internal_buffer, m_ready_buffer);
+        m_frame_ready = true;
+    }
+
+    //Whether a frame has been presented since the window was last drawn
+    bool frame_ready() {
+        return m_frame_ready;
     }
 
     void present_to_window(SDL_Rect dst_rect) {
@@ -41,12 +54,24 @@ public:
         SDL_RenderPresent(m_renderer);
     }
 
+    //Uploads the last presented frame if it hasn't been already
     SDL_Texture* get_texture() {
-        if(m_texture != nullptr) {
-            SDL_DestroyTexture(m_texture);
-        }
+        std::lock_guard<std::mutex> lock(m_frame_lock);
+
+        if(m_frame_ready) {
+            void *pixels;
+            int pitch;
+
+            if(SDL_LockTexture(m_texture, nullptr, &pixels, &pitch) == 0) {
+                for(u32 y = 0; y < m_internal_height; y++) {
+                    sb::shades_to_rgba(m_ready_buffer + y * m_internal_width, sb::DMG_SHADES, reinterpret_cast<u32*>(reinterpret_cast<u8*>(pixels) + y * pitch), m_internal_width);
+                }
 
-        m_texture = SDL_CreateTextureFromSurface(m_renderer, m_surface);
+                SDL_UnlockTexture(m_texture);
+            }
+
+            m_frame_ready = false;
+        }
 
         return m_texture;
     }
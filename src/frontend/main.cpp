@@ -9,6 +9,10 @@
 #include <stb_image.h>
 #include <SDL.h>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 
 static constexpr struct {
@@ -64,6 +68,11 @@ int main(int argc, char *argv[]) {
     args.add_option(ap::Builder().lname("stub-ly").help("Stubs LY to 0x90, or 144. For logging purposes, only used with --headless.").build());
     args.add_option(ap::Builder().lname("no-save").help("Doesn't save MBC external RAM to a file or load from a file.").build());
     args.add_option(ap::Builder().lname("force-model").sname("f").param().def_param("DMG").help("Forces a certain Gameboy model (DMG or CGB).").build());
+    args.add_option(ap::Builder().lname("jit").help("Compiles hot code to native x86-64 instead of interpreting all of it.").build());
+    args.add_option(ap::Builder().lname("jit-lockstep").help("Same as --jit, but checks every compiled run against the interpreter and stops on any difference.").build());
+    args.add_option(ap::Builder().lname("scanline-renderer").help("Draws whole lines at once instead of emulating the pixel FIFO, lines that change mid-line still use the FIFO.").build());
+    args.add_option(ap::Builder().lname("frame-skip").param().help("Only draws one frame out of every N + 1, the rest are still emulated.").build());
+    args.add_option(ap::Builder().lname("vsync").help("Waits for the display's vertical blank when drawing the window.").build());
     args.parse_args(argc, argv);
 
     //Show usage message
@@ -101,6 +110,12 @@ int main(int argc, char *argv[]) {
         LOG_INFO("Forcing model {}", args.get_param_any("f"));
     }
 
+    bool jit_lockstep = args.is_set("jit-lockstep");
+    bool jit = args.is_set("jit") || jit_lockstep;
+    bool scanline_renderer = args.is_set("scanline-renderer");
+    bool vsync = args.is_set("vsync");
+    u32 frame_skip = args.is_set("frame-skip") ? std::stoul(args.get_param("frame-skip")) : 0;
+
     //With window
     if(!args.is_set("headless")) {
         int w, h, channels;
@@ -113,14 +128,15 @@ int main(int argc, char *argv[]) {
         //Allow dropfile events
         SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
 
-        SDLVideoDevice video_device(window, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
+        SDLVideoDevice video_device(window, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, vsync);
         SDLInputDevice input_device;
         SDLAudioDevice audio_device;
 
-        sb::Gameboy gb(args.other_args[0], args.get_param_any("boot-rom"), {video_device, input_device, audio_device, model, args.is_set_any("f"), !args.is_set("no-save")});
-        audio_device.set_sync(true, &gb);
+        sb::Gameboy gb(args.other_args[0], args.get_param_any("boot-rom"), {video_device, input_device, audio_device, model, args.is_set_any("f"), !args.is_set("no-save"), false, jit, jit_lockstep, scanline_renderer});
+        audio_device.set_sync(true);
         audio_device.start();
 
+        gb.set_frame_skip(frame_skip);
         SDL_SetWindowTitle(window, fmt::format("Smol Boy - {}", gb.get_title()).c_str());
 
         SDL_Rect dst_rect = {0, 0, GB_SCREEN_WIDTH * 4, GB_SCREEN_HEIGHT * 4};
@@ -132,12 +148,50 @@ int main(int argc, char *argv[]) {
         video_device.clear_screen(0xffffffff);
         video_device.present_screen();
 
-        bool finished = false;
+        std::atomic<bool> finished = false;
+        std::mutex emu_lock; //Held by whichever thread is touching the Gameboy
+
+        //The emulator runs on its own thread, a frame at a time, paced by the clock. It used to run inside the audio
+        //callback, which made the sound card's timing everyone's problem and stalled audio whenever a frame took long.
+        std::thread emu_thread([&]() {
+            using clock = std::chrono::steady_clock;
+            const auto frame_time = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>((double)CYCLES_PER_FRAME / sb::CLOCK_SPEED));
+            auto next_frame = clock::now();
+
+            while(!finished) {
+                bool syncing = audio_device.syncing();
+
+                if(syncing) {
+                    audio_device.update_rate();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(emu_lock);
+                    gb.run_for(CYCLES_PER_FRAME);
+                }
+
+                if(syncing) {
+                    next_frame += frame_time;
+
+                    //Don't try to make up for a long stall by running flat out, just start again from now
+                    if(clock::now() > next_frame + frame_time * 4) {
+                        next_frame = clock::now();
+                    }
+
+                    std::this_thread::sleep_until(next_frame);
+                } else {
+                    next_frame = clock::now();
+                }
+            }
+        });
 
         while(!finished) {
             SDL_Event event;
             while(SDL_PollEvent(&event)) {
-                input_device.handle_event(event);
+                {
+                    std::lock_guard<std::mutex> lock(emu_lock);
+                    input_device.handle_event(event);
+                }
 
                 if(event.type == SDL_QUIT) {
                     finished = true;
@@ -145,6 +199,7 @@ int main(int argc, char *argv[]) {
 
                 //Drop file
                 if(event.type == SDL_DROPFILE) {
+                    std::lock_guard<std::mutex> lock(emu_lock);
                     gb.save_ram();
                     gb.load_rom(event.drop.file, !args.is_set("no-save"));
                     SDL_SetWindowTitle(window, fmt::format("Smol Boy - {}", gb.get_title()).c_str());
@@ -152,28 +207,31 @@ int main(int argc, char *argv[]) {
 
                 //Fast Forward Hotkey
                 if(event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_U) {
-                    audio_device.stop();
-                    audio_device.set_sync(!audio_device.syncing(), &gb);
-                    audio_device.start();
+                    audio_device.set_sync(!audio_device.syncing());
                 }
             }
 
-            if(!audio_device.syncing()) {
-                gb.run_for(CYCLES_PER_FRAME);
+            //Only redraw when there's something new, the emulation thread sets the pace. With vsync presenting waits
+            //for the display anyway.
+            if(vsync || video_device.frame_ready()) {
+                video_device.present_to_window(dst_rect);
+            } else {
+                SDL_Delay(1);
             }
-
-            video_device.present_to_window(dst_rect);
         }
 
+        emu_thread.join();
+
         SDL_DestroyWindow(window);
 
         SDL_FreeSurface(logo);
         stbi_image_free(logo_pixels);
     } else {
-        sb::NullVideoDevice video_device(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
+        sb::NullVideoDevice video_device(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, sb::FORMAT_SHADES); //Nothing looks at the colors
         sb::NullInputDevice input_device;
         sb::NullAudioDevice audio_device;
-        sb::Gameboy gb(args.other_args[0], args.get_param_any("boot-rom"), {video_device, input_device, audio_device, model, args.is_set_any("f"), false, args.is_set("stub-ly")}); //No saving RAM with headless
+        sb::Gameboy gb(args.other_args[0], args.get_param_any("boot-rom"), {video_device, input_device, audio_device, model, args.is_set_any("f"), false, args.is_set("stub-ly"), jit, jit_lockstep, scanline_renderer}); //No saving RAM with headless
+        gb.set_frame_skip(sb::FRAME_SKIP_ALL); //Nothing would ever see it
 
         while(true) {
             gb.run_for(CYCLES_PER_FRAME);
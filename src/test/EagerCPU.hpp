@@ -0,0 +1,423 @@
+#ifndef EAGER_CPU_HPP
+#define EAGER_CPU_HPP
+
+#include "common/Types.hpp"
+
+#include <cstring>
+
+
+//The reference the flag test checks the emulator's CPU against. F is worked out in full by every instruction that
+//touches it, the way the emulator did before it went lazy, and nothing else is clever either: one big switch, a flat
+//64 KiB of memory. The timings are the emulator's own rather than the documented ones, they're off in a few places
+//(ALU ops with a byte of memory, the CB ops) that the flags don't care about. Instructions are handed in one at a time,
+//so there's no fetching.
+struct EagerCPU {
+    enum Flag : u8 {
+        ZERO = 128, SUBTRACTION = 64, HALF_CARRY = 32, CARRY = 16
+    };
+
+    u8 a, f, b, c, d, e, h, l;
+    u16 sp, pc;
+    u64 cycles = 0; //M-cycles, the opcode fetch included
+
+    u8 memory[0x10000];
+    u16 written[2]; //Where the last instruction wrote, so only those have to be compared
+    u32 write_count;
+
+    EagerCPU() {
+        memset(memory, 0, sizeof(memory));
+    }
+
+    u16 bc() { return b << 8 | c; }
+    u16 de() { return d << 8 | e; }
+    u16 hl() { return h << 8 | l; }
+    void set_bc(u16 value) { b = value >> 8; c = value; }
+    void set_de(u16 value) { d = value >> 8; e = value; }
+    void set_hl(u16 value) { h = value >> 8; l = value; }
+
+    bool flag(Flag which) { return f & which; }
+
+    void set_flags(bool zero, bool subtract, bool half, bool carry) {
+        f = zero << 7 | subtract << 6 | half << 5 | carry << 4;
+    }
+
+    u8 read(u16 address) { return memory[address]; }
+
+    void write(u16 address, u8 value) {
+        memory[address] = value;
+        written[write_count++] = address;
+    }
+
+    void push(u16 value) {
+        write(--sp, value >> 8);
+        write(--sp, value & 0xFF);
+    }
+
+    u16 pop() {
+        u16 value = read(sp) | read(sp + 1) << 8;
+        sp += 2;
+        return value;
+    }
+
+    //B, C, D, E, H, L, (HL), A, the order the opcodes use
+    u8 get_r(u8 index) {
+        switch(index) {
+            case 0 : return b;
+            case 1 : return c;
+            case 2 : return d;
+            case 3 : return e;
+            case 4 : return h;
+            case 5 : return l;
+            case 6 : return read(hl());
+            default : return a;
+        }
+    }
+
+    void set_r(u8 index, u8 value) {
+        switch(index) {
+            case 0 : b = value; break;
+            case 1 : c = value; break;
+            case 2 : d = value; break;
+            case 3 : e = value; break;
+            case 4 : h = value; break;
+            case 5 : l = value; break;
+            case 6 : write(hl(), value); break;
+            default : a = value; break;
+        }
+    }
+
+    //BC, DE, HL, SP
+    u16 get_rp(u8 index) {
+        switch(index) {
+            case 0 : return bc();
+            case 1 : return de();
+            case 2 : return hl();
+            default : return sp;
+        }
+    }
+
+    void set_rp(u8 index, u16 value) {
+        switch(index) {
+            case 0 : set_bc(value); break;
+            case 1 : set_de(value); break;
+            case 2 : set_hl(value); break;
+            default : sp = value; break;
+        }
+    }
+
+    //NZ, Z, NC, C
+    bool condition(u8 index) {
+        switch(index) {
+            case 0 : return !flag(ZERO);
+            case 1 : return flag(ZERO);
+            case 2 : return !flag(CARRY);
+            default : return flag(CARRY);
+        }
+    }
+
+    //ADD, ADC, SUB, SBC, AND, XOR, OR, CP
+    void alu(u8 operation, u8 n) {
+        u8 carry = flag(CARRY);
+        u8 result;
+
+        switch(operation) {
+            case 0 :
+                result = a + n;
+                set_flags(result == 0, false, (a & 0xF) + (n & 0xF) > 0xF, a + n > 0xFF);
+                a = result;
+                break;
+            case 1 :
+                result = a + n + carry;
+                set_flags(result == 0, false, (a & 0xF) + (n & 0xF) + carry > 0xF, a + n + carry > 0xFF);
+                a = result;
+                break;
+            case 2 :
+                result = a - n;
+                set_flags(result == 0, true, (a & 0xF) < (n & 0xF), a < n);
+                a = result;
+                break;
+            case 3 :
+                result = a - n - carry;
+                set_flags(result == 0, true, (a & 0xF) < (n & 0xF) + carry, a < n + carry);
+                a = result;
+                break;
+            case 4 :
+                a &= n;
+                set_flags(a == 0, false, true, false);
+                break;
+            case 5 :
+                a ^= n;
+                set_flags(a == 0, false, false, false);
+                break;
+            case 6 :
+                a |= n;
+                set_flags(a == 0, false, false, false);
+                break;
+            default :
+                result = a - n;
+                set_flags(result == 0, true, (a & 0xF) < (n & 0xF), a < n);
+                break;
+        }
+    }
+
+    //SP plus a signed byte, for ADD SP, e and LD HL, SP + e. The flags come from the unsigned low byte.
+    u16 add_sp(u8 n) {
+        set_flags(false, false, (sp & 0xF) + (n & 0xF) > 0xF, (sp & 0xFF) + n > 0xFF);
+        return sp + (s8)n;
+    }
+
+    //RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+    u8 shift(u8 operation, u8 value) {
+        u8 result;
+        bool carry;
+
+        switch(operation) {
+            case 0 : result = value << 1 | value >> 7; carry = value & 0x80; break;
+            case 1 : result = value >> 1 | value << 7; carry = value & 1; break;
+            case 2 : result = value << 1 | flag(CARRY); carry = value & 0x80; break;
+            case 3 : result = value >> 1 | flag(CARRY) << 7; carry = value & 1; break;
+            case 4 : result = value << 1; carry = value & 0x80; break;
+            case 5 : result = (value >> 1) | (value & 0x80); carry = value & 1; break;
+            case 6 : result = value << 4 | value >> 4; carry = false; break;
+            default : result = value >> 1; carry = value & 1; break;
+        }
+
+        set_flags(result == 0, false, false, carry);
+        return result;
+    }
+
+    void daa() {
+        bool carry = flag(CARRY);
+
+        if(!flag(SUBTRACTION)) {
+            if(carry || a > 0x99) { a += 0x60; carry = true; }
+            if(flag(HALF_CARRY) || (a & 0xF) > 0x9) { a += 0x6; }
+        } else {
+            if(carry) { a -= 0x60; }
+            if(flag(HALF_CARRY)) { a -= 0x6; }
+        }
+
+        set_flags(a == 0, flag(SUBTRACTION), false, carry);
+    }
+
+    void prefix_cb(u8 opcode) {
+        u8 bit = (opcode >> 3) & 7;
+        u8 index = opcode & 7;
+        u8 value = get_r(index);
+        cycles += index != 6 ? 3 : opcode >= 0x80 ? 5 : 4;
+
+        switch(opcode >> 6) {
+            case 0 : set_r(index, shift(bit, value)); break;
+            case 1 : set_flags(!((value >> bit) & 1), false, true, flag(CARRY)); break;
+            case 2 : set_r(index, value & ~(1 << bit)); break;
+            default : set_r(index, value | (1 << bit)); break;
+        }
+    }
+
+    //Runs one instruction, first and second being the bytes after the opcode. HALT, STOP and the illegal opcodes
+    //aren't handled, the test never gives them.
+    void step(u8 opcode, u8 first, u8 second) {
+        u16 nn = second << 8 | first;
+        u8 x = opcode >> 6;
+        u8 y = (opcode >> 3) & 7;
+        u8 z = opcode & 7;
+        u8 p = y >> 1;
+        bool q = y & 1;
+        write_count = 0;
+        pc++;
+
+        if(x == 1) {
+            //LD r, r'
+            set_r(y, get_r(z));
+            cycles += 1 + (y == 6 || z == 6);
+            return;
+        }
+
+        if(x == 2) {
+            //ALU A, r, the read from (HL) doesn't take a cycle of its own
+            alu(y, get_r(z));
+            cycles += 1;
+            return;
+        }
+
+        if(x == 0) {
+            switch(z) {
+                case 0 :
+                    if(y == 0) {
+                        cycles += 1;
+                    } else if(y == 1) {
+                        write(nn, sp & 0xFF);
+                        write(nn + 1, sp >> 8);
+                        pc += 2;
+                        cycles += 5;
+                    } else if(y == 3 || (y >= 4 && condition(y - 4))) {
+                        pc += 1 + (s8)first;
+                        cycles += 3;
+                    } else {
+                        pc += 1;
+                        cycles += 2;
+                    }
+                    break;
+                case 1 :
+                    if(!q) {
+                        set_rp(p, nn);
+                        pc += 2;
+                        cycles += 3;
+                    } else {
+                        u16 n = get_rp(p);
+                        set_flags(flag(ZERO), false, (hl() & 0xFFF) + (n & 0xFFF) > 0xFFF, hl() + n > 0xFFFF);
+                        set_hl(hl() + n);
+                        cycles += 2;
+                    }
+                    break;
+                case 2 : {
+                    u16 address = p == 0 ? bc() : p == 1 ? de() : hl();
+                    if(!q) write(address, a); else a = read(address);
+                    if(p == 2) set_hl(hl() + 1);
+                    if(p == 3) set_hl(hl() - 1);
+                    cycles += 2;
+                    break;
+                }
+                case 3 :
+                    set_rp(p, get_rp(p) + (q ? -1 : 1));
+                    cycles += 2;
+                    break;
+                case 4 : {
+                    u8 result = get_r(y) + 1;
+                    set_r(y, result);
+                    set_flags(result == 0, false, (result & 0xF) == 0, flag(CARRY));
+                    cycles += y == 6 ? 3 : 1;
+                    break;
+                }
+                case 5 : {
+                    u8 result = get_r(y) - 1;
+                    set_r(y, result);
+                    set_flags(result == 0, true, (result & 0xF) == 0xF, flag(CARRY));
+                    cycles += y == 6 ? 3 : 1;
+                    break;
+                }
+                case 6 :
+                    set_r(y, first);
+                    pc += 1;
+                    cycles += y == 6 ? 3 : 2;
+                    break;
+                default :
+                    cycles += 1;
+
+                    switch(y) {
+                        case 0 : case 1 : case 2 : case 3 : a = shift(y, a); f &= ~ZERO; break;
+                        case 4 : daa(); break;
+                        case 5 : a = ~a; f |= SUBTRACTION | HALF_CARRY; break;
+                        case 6 : set_flags(flag(ZERO), false, false, true); break;
+                        default : set_flags(flag(ZERO), false, false, !flag(CARRY)); break;
+                    }
+                    break;
+            }
+            return;
+        }
+
+        switch(z) {
+            case 0 :
+                if(y < 4) {
+                    if(condition(y)) {
+                        pc = pop();
+                        cycles += 5;
+                    } else {
+                        cycles += 2;
+                    }
+                } else if(y == 4) {
+                    write(0xFF00 + first, a);
+                    pc += 1;
+                    cycles += 3;
+                } else if(y == 5) {
+                    sp = add_sp(first);
+                    pc += 1;
+                    cycles += 4;
+                } else if(y == 6) {
+                    a = read(0xFF00 + first);
+                    pc += 1;
+                    cycles += 3;
+                } else {
+                    set_hl(add_sp(first));
+                    pc += 1;
+                    cycles += 3;
+                }
+                break;
+            case 1 :
+                if(!q) {
+                    u16 value = pop();
+                    if(p == 3) { a = value >> 8; f = value & 0xF0; } else { set_rp(p, value); }
+                    cycles += 3;
+                } else if(p < 2) {
+                    pc = pop(); //RET and RETI
+                    cycles += 4;
+                } else if(p == 2) {
+                    pc = hl();
+                    cycles += 1;
+                } else {
+                    sp = hl();
+                    cycles += 2;
+                }
+                break;
+            case 2 :
+                if(y < 4) {
+                    pc += 2;
+                    if(condition(y)) { pc = nn; cycles += 4; } else { cycles += 3; }
+                } else if(y == 4) {
+                    write(0xFF00 + c, a);
+                    cycles += 2;
+                } else if(y == 5) {
+                    write(nn, a);
+                    pc += 2;
+                    cycles += 4;
+                } else if(y == 6) {
+                    a = read(0xFF00 + c);
+                    cycles += 2;
+                } else {
+                    a = read(nn);
+                    pc += 2;
+                    cycles += 4;
+                }
+                break;
+            case 3 :
+                if(y == 0) {
+                    pc = nn;
+                    cycles += 4;
+                } else if(y == 1) {
+                    pc += 1;
+                    prefix_cb(first);
+                } else {
+                    cycles += 1; //DI and EI, the interrupt flag isn't checked
+                }
+                break;
+            case 4 :
+                pc += 2;
+                if(condition(y)) { push(pc); pc = nn; cycles += 6; } else { cycles += 3; }
+                break;
+            case 5 :
+                if(!q) {
+                    push(p == 3 ? (a << 8 | f) : get_rp(p));
+                    cycles += 4;
+                } else {
+                    pc += 2;
+                    push(pc);
+                    pc = nn;
+                    cycles += 6;
+                }
+                break;
+            case 6 :
+                alu(y, first);
+                pc += 1;
+                cycles += 1; //Same as above, the byte is just there
+                break;
+            default :
+                push(pc);
+                pc = y * 8;
+                cycles += 4;
+                break;
+        }
+    }
+};
+
+
+#endif //EAGER_CPU_HPP
\ No newline at end of file
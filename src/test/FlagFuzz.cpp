@@ -0,0 +1,186 @@
+#include "EagerCPU.hpp"
+#include "emulator/core/Gameboy.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <fmt/format.h>
+
+
+//Runs random sequences of 1 to 8 instructions on the emulator's CPU and on EagerCPU, and after every instruction
+//compares the registers, F, whatever memory got written and the cycles taken. The CPU only puts F together when
+//something reads it, so this is what keeps that honest. Takes a seed and a number of sequences, both optional.
+
+constexpr usize DEFAULT_SEQUENCES = 1000000;
+constexpr usize ROM_SIZE = 32 * KiB;
+
+//Everything stays in work RAM or HRAM so nothing but memory gets touched, sequences end early once a pointer leaves
+constexpr u16 WRAM_START = 0xC000;
+constexpr u16 WRAM_END = 0xDE00;
+constexpr u16 HRAM_START = 0xFF80;
+constexpr u16 HRAM_END = 0xFFFF;
+
+namespace sb {
+
+class FlagFuzzer {
+private:
+
+    NullVideoDevice m_video{160, 144};
+    NullInputDevice m_input;
+    NullAudioDevice m_audio;
+
+    Gameboy m_gameboy;
+    CPU &m_cpu;
+    Memory &m_mem;
+    EagerCPU m_reference;
+
+    std::mt19937 m_random;
+
+    //HALT, STOP and the illegal opcodes
+    static bool skipped(u8 opcode) {
+        switch(opcode) {
+            case 0x10 : case 0x76 : case 0xD3 : case 0xDB : case 0xDD : case 0xE3 : case 0xE4 :
+            case 0xEB : case 0xEC : case 0xED : case 0xF4 : case 0xFC : case 0xFD : return true;
+            default : return false;
+        }
+    }
+
+    static bool in_wram(u16 address) {
+        return address >= WRAM_START && address < WRAM_END;
+    }
+
+    //Whether the next instruction could reach outside of work RAM, the stack needs room for a push
+    bool wandered() {
+        return !in_wram(m_reference.bc()) || !in_wram(m_reference.de()) || !in_wram(m_reference.hl()) ||
+        !in_wram(m_reference.sp) || m_reference.sp < WRAM_START + 2;
+    }
+
+    void write(u16 address, u8 value) {
+        m_reference.memory[address] = value;
+        m_mem.write(address, value);
+    }
+
+    //Random registers with every pointer somewhere in work RAM, copied over to the CPU
+    void randomize() {
+        m_reference.a = m_random();
+        m_reference.f = m_random() & 0xF0;
+        m_reference.set_bc(WRAM_START + m_random() % 0x1E00);
+        m_reference.set_de(WRAM_START + m_random() % 0x1E00);
+        m_reference.set_hl(WRAM_START + m_random() % 0x1E00);
+        m_reference.sp = WRAM_START + 0x10 + m_random() % 0x1DF0;
+        m_reference.pc = WRAM_START;
+
+        m_cpu.af.hi = m_reference.a;
+        m_cpu.af.lo = m_reference.f;
+        m_cpu.bc.value = m_reference.bc();
+        m_cpu.de.value = m_reference.de();
+        m_cpu.hl.value = m_reference.hl();
+        m_cpu.sp.value = m_reference.sp;
+        m_cpu.pc.value = m_reference.pc;
+        m_cpu.unpack_flags();
+    }
+
+    //A random instruction, with anything that takes an address pointed at work RAM or HRAM
+    void random_instruction(u8 &opcode, u8 &first, u8 &second) {
+        do { opcode = m_random(); } while(skipped(opcode));
+        first = m_random();
+        second = m_random();
+
+        switch(opcode) {
+            case 0x08 : case 0xEA : case 0xFA : second = (WRAM_START >> 8) + m_random() % 0x1E; break;
+            case 0xE0 : case 0xF0 : first = 0x80 + m_random() % 0x7F; break;
+            case 0xE2 : case 0xF2 : opcode = 0x00; break; //C is anything, NOP instead
+        }
+    }
+
+    bool compare(u8 opcode, u8 first, u8 second, u64 cycles) {
+        m_cpu.pack_flags();
+
+        bool same = m_cpu.af.hi == m_reference.a && m_cpu.af.lo == m_reference.f && m_cpu.bc.value == m_reference.bc() &&
+        m_cpu.de.value == m_reference.de() && m_cpu.hl.value == m_reference.hl() && m_cpu.sp.value == m_reference.sp &&
+        m_cpu.pc.value == m_reference.pc && cycles == m_reference.cycles;
+
+        for(u32 i = 0; i < m_reference.write_count; i++) {
+            same = same && m_mem.read(m_reference.written[i]) == m_reference.memory[m_reference.written[i]];
+        }
+
+        if(!same) {
+            fmt::print("Mismatch after {:02X} {:02X} {:02X}\n", opcode, first, second);
+            fmt::print("  Reference: AF={:02X}{:02X} BC={:04X} DE={:04X} HL={:04X} SP={:04X} PC={:04X} cycles={}\n", m_reference.a,
+            m_reference.f, m_reference.bc(), m_reference.de(), m_reference.hl(), m_reference.sp, m_reference.pc, m_reference.cycles);
+            fmt::print("  CPU:       AF={:04X} BC={:04X} DE={:04X} HL={:04X} SP={:04X} PC={:04X} cycles={}\n", m_cpu.af.value,
+            m_cpu.bc.value, m_cpu.de.value, m_cpu.hl.value, m_cpu.sp.value, m_cpu.pc.value, cycles);
+        }
+
+        return same;
+    }
+
+public:
+
+    FlagFuzzer(const std::string &rom_path, u32 seed) : m_gameboy(rom_path, "", GameboySettings{m_video, m_input, m_audio, DMG, true, false}),
+    m_cpu(m_gameboy.m_cpu), m_mem(m_gameboy.m_memory), m_random(seed) {
+        for(u32 address = WRAM_START; address < HRAM_END; address++) {
+            if(in_wram(address) || address >= HRAM_START) {
+                write(address, m_random());
+            }
+        }
+    }
+
+    bool run(usize sequences) {
+        usize instructions = 0;
+
+        for(usize i = 0; i < sequences; i++) {
+            randomize();
+            u32 length = 1 + m_random() % 8;
+
+            for(u32 j = 0; j < length; j++) {
+                u8 opcode, first, second;
+                random_instruction(opcode, first, second);
+
+                //The CPU leaves the opcode fetch to whatever's running it, so that cycle is added here
+                u64 start = m_cpu.m_clock.get_m();
+                m_reference.cycles = 0;
+                m_reference.step(opcode, first, second);
+                m_cpu.m_opcode = opcode;
+                m_cpu.pc.value += 1 + (m_cpu.*CPU::m_opcodes[opcode])(first, second);
+                instructions++;
+
+                if(!compare(opcode, first, second, m_cpu.m_clock.get_m() - start + 1)) {
+                    fmt::print("Sequence {}, instruction {}\n", i, j);
+                    return false;
+                }
+
+                if(wandered()) {
+                    break;
+                }
+            }
+        }
+
+        //Anything written somewhere it shouldn't have been
+        for(u32 address = WRAM_START; address < HRAM_END; address++) {
+            if((in_wram(address) || address >= HRAM_START) && m_mem.read(address) != m_reference.memory[address]) {
+                fmt::print("Memory differs at 0x{:04X}\n", address);
+                return false;
+            }
+        }
+
+        fmt::print("{} sequences, {} instructions, all the same\n", sequences, instructions);
+        return true;
+    }
+};
+
+} //namespace sb
+
+int main(int argc, char **argv) {
+    u32 seed = argc > 1 ? std::stoul(argv[1]) : 1;
+    usize sequences = argc > 2 ? std::stoull(argv[2]) : DEFAULT_SEQUENCES;
+
+    //An empty ROM, the instructions are handed to the CPU directly
+    std::string rom_path = (std::filesystem::temp_directory_path() / "flag_fuzz.gb").string();
+    std::ofstream(rom_path, std::ios::binary) << std::string(ROM_SIZE, '\0');
+
+    bool passed = sb::FlagFuzzer(rom_path, seed).run(sequences);
+    std::filesystem::remove(rom_path);
+
+    return passed ? 0 : 1;
+}
\ No newline at end of file